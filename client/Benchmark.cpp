@@ -0,0 +1,431 @@
+#include "Benchmark.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <stdexcept>
+#include <string_view>
+#include <sys/epoll.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "Generator.h"
+#include "ICalc.h"
+#include "LatencyHistogram.h"
+#include "Protocol.h"
+#include "Socket.h"
+#include "TimerQueue.h"
+
+struct PooledExpression {
+    std::string expr;
+    double expected = 0.0;
+    // Exact response text under --exact; empty when the server answers
+    // with a rounded double.
+    std::string text;
+    bool expect_error = false;
+};
+
+namespace {
+
+constexpr int MAX_EVENTS = 256;
+constexpr int BUFFER_SIZE = 16384;
+// Distinct expressions cycled through during a run; generating and
+// evaluating them up front keeps the load loop cheap.
+constexpr size_t POOL_SIZE = 1024;
+constexpr uint64_t TIMER_ID = ~uint64_t{0};
+
+constexpr double kPercentiles[] = {50.0, 90.0, 99.0, 99.9};
+constexpr const char* kPercentileNames[] = {"p50", "p90", "p99", "p99.9"};
+
+uint64_t seconds_to_ns(double seconds) { return static_cast<uint64_t>(seconds * 1e9); }
+
+struct Outstanding {
+    // When the request was due; latency is measured from here.
+    uint64_t intended_ns;
+    uint32_t id;
+    uint32_t expr;
+};
+
+struct BenchConn {
+    int fd = -1;
+    std::string out;
+    size_t out_offset = 0;
+    std::string in;
+    std::deque<Outstanding> inflight;
+};
+
+// The server rounds to two decimals itself, so a value exactly halfway
+// between may land on either side.
+bool matches_2dp(double expected, double actual) {
+    return std::fabs(expected - actual) <= 0.005 + 1e-9 * std::max(1.0, std::fabs(expected));
+}
+
+bool matches_exact(double expected, double actual) {
+    return std::fabs(expected - actual) <= 1e-9 * std::max(1.0, std::fabs(expected));
+}
+
+bool check_text(const PooledExpression& e, std::string_view line) {
+    if (line.compare(0, 5, "Error") == 0) return e.expect_error;
+    if (e.expect_error) return false;
+    if (!e.text.empty()) return line == e.text;
+    try {
+        return matches_2dp(e.expected, std::stod(std::string(line)));
+    } catch (...) {
+        return false;
+    }
+}
+
+bool check_binary(const PooledExpression& e, const protocol::Response& response) {
+    if (response.status != 0) return e.expect_error;
+    if (e.expect_error) return false;
+    return e.text.empty() ? matches_exact(e.expected, response.value) : e.expected == response.value;
+}
+
+std::string format_us(uint64_t ns) {
+    char buf[32];
+    std::snprintf(buf, sizeof(buf), "%.1f", ns / 1000.0);
+    return buf;
+}
+
+}
+
+// What one event loop measured; the report merges all of them.
+struct BenchmarkTotals {
+    LatencyHistogram latency;
+    uint64_t mismatched = 0;
+    uint64_t failed = 0;
+    uint64_t connections = 0;
+    uint64_t in_flight = 0;
+};
+
+Benchmark::Benchmark(int n, int connections, const std::string& server_ip, int server_port, bool binary,
+                     const BenchmarkOptions& options, const LoadOptions& load)
+    : n_(n),
+      connections_(connections),
+      server_ip_(server_ip),
+      server_port_(server_port),
+      binary_(binary),
+      options_(options),
+      load_(load) {}
+
+void Benchmark::run() {
+    Generator generator;
+    CalcImpl evaluator;
+
+    std::vector<PooledExpression> pool(POOL_SIZE);
+    for (PooledExpression& e : pool) {
+        e.expr = generator.generate_expression(n_);
+        while (!e.expr.empty() && e.expr.back() == ' ') e.expr.pop_back();
+        try {
+            Rational exact;
+            if (load_.exact && evaluator.calculate_exact(e.expr, exact)) {
+                char buf[Rational::kMaxFormatted];
+                e.text.assign(buf, exact.format_2dp(buf));
+                e.expected = exact.to_double();
+            } else {
+                e.expected = evaluator.calculate(e.expr);
+            }
+        } catch (...) {
+            e.expect_error = true;
+        }
+    }
+
+    // All loops share one clock origin, so warmup and the measured window
+    // line up across threads.
+    const uint64_t start = monotonic_ns();
+    std::vector<BenchmarkTotals> per_thread(load_.threads);
+    std::vector<std::thread> threads;
+    for (int t = 1; t < load_.threads; ++t) {
+        threads.emplace_back([this, t, start, &pool, &per_thread] {
+            try {
+                run_loop(t, start, pool, per_thread[t]);
+            } catch (const std::exception& e) {
+                fprintf(stderr, "Thread error: %s\n", e.what());
+            }
+        });
+    }
+    run_loop(0, start, pool, per_thread[0]);
+    for (auto& thread : threads) thread.join();
+
+    BenchmarkTotals totals;
+    for (const BenchmarkTotals& t : per_thread) {
+        totals.latency.merge(t.latency);
+        totals.mismatched += t.mismatched;
+        totals.failed += t.failed;
+        totals.connections += t.connections;
+        totals.in_flight += t.in_flight;
+    }
+    if (totals.connections == 0) throw std::runtime_error("No connection could be opened");
+    report(totals);
+}
+
+// Drives every load_.threads-th connection, starting at thread, on its own
+// epoll instance. In open loop the threads interleave their due times, so
+// together they still send at options_.rate.
+void Benchmark::run_loop(int thread, uint64_t start, const std::vector<PooledExpression>& pool,
+                         BenchmarkTotals& totals) {
+    int epfd = epoll_create1(0);
+    if (epfd < 0) {
+        perror("epoll_create1");
+        throw std::runtime_error("Failed to create epoll instance");
+    }
+
+    std::vector<BenchConn> conns;
+    conns.reserve(connections_ / load_.threads + 1);
+    for (int i = thread; i < connections_; i += load_.threads) {
+        uint32_t source = load_.sources.empty() ? 0 : load_.sources.pick(i);
+        int fd = connect_nonblocking(server_ip_, server_port_, source);
+        if (fd < 0) continue;
+
+        BenchConn c;
+        c.fd = fd;
+        if (binary_) c.out.assign(protocol::kBinaryPreface, sizeof(protocol::kBinaryPreface));
+        conns.push_back(std::move(c));
+
+        epoll_event ev{};
+        ev.data.u64 = conns.size() - 1;
+        ev.events = EPOLLIN | EPOLLOUT | EPOLLET | EPOLLRDHUP;
+        if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+            perror("epoll_ctl");
+            close(fd);
+            conns.pop_back();
+        }
+    }
+    totals.connections = conns.size();
+    if (conns.empty()) {
+        close(epfd);
+        return;
+    }
+
+    TimerQueue timers;
+    epoll_event timer_ev{};
+    timer_ev.data.u64 = TIMER_ID;
+    timer_ev.events = EPOLLIN;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, timers.fd(), &timer_ev);
+
+    size_t alive = conns.size();
+    uint32_t next_id = 0;
+
+    const uint64_t measure_start = start + seconds_to_ns(options_.warmup);
+    const uint64_t end = measure_start + seconds_to_ns(options_.duration);
+    const bool open_loop = options_.rate > 0;
+    const double interval = open_loop ? 1e9 / options_.rate : 0.0;
+    uint64_t scheduled = 0;
+    size_t next_conn = 0;
+
+    auto drop = [&](BenchConn& c) {
+        if (c.fd < 0) return;
+        totals.failed += c.inflight.size();
+        c.inflight.clear();
+        epoll_ctl(epfd, EPOLL_CTL_DEL, c.fd, nullptr);
+        close(c.fd);
+        c.fd = -1;
+        --alive;
+    };
+
+    auto flush = [&](BenchConn& c) {
+        while (c.out_offset < c.out.size()) {
+            ssize_t sent = send(c.fd, c.out.data() + c.out_offset, c.out.size() - c.out_offset, MSG_NOSIGNAL);
+            if (sent > 0) {
+                c.out_offset += sent;
+            } else if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOTCONN)) {
+                return;
+            } else {
+                perror("send");
+                drop(c);
+                return;
+            }
+        }
+        c.out.clear();
+        c.out_offset = 0;
+    };
+
+    auto submit = [&](BenchConn& c, uint64_t intended) {
+        uint32_t id = next_id++;
+        uint32_t index = id % POOL_SIZE;
+        if (binary_) {
+            protocol::append_request(c.out, id, 0, pool[index].expr);
+        } else {
+            c.out += pool[index].expr;
+            c.out += ' ';
+        }
+        c.inflight.push_back({intended, id, index});
+        flush(c);
+    };
+
+    auto complete = [&](BenchConn& c, const Outstanding& request, bool ok, uint64_t now) {
+        if (!ok) ++totals.mismatched;
+        if (request.intended_ns >= measure_start && now < end) totals.latency.record(now - request.intended_ns);
+        if (!open_loop && now < end && c.fd >= 0) submit(c, now);
+    };
+
+    if (!open_loop) {
+        for (BenchConn& c : conns) submit(c, start);
+    }
+    // The loop sleeps in epoll_wait() until a socket or the timer is ready:
+    // the end of the run, and in open loop the next request's due time.
+    timers.schedule(end, 0);
+    uint64_t armed_due = 0;
+
+    epoll_event events[MAX_EVENTS];
+    while (alive > 0) {
+        uint64_t now = monotonic_ns();
+        if (now >= end) break;
+
+        if (open_loop) {
+            // Everything that has come due goes out now, however late.
+            while (true) {
+                uint64_t due = start + static_cast<uint64_t>((scheduled * load_.threads + thread) * interval);
+                if (due > now) {
+                    if (due < end && due != armed_due) {
+                        timers.schedule(due, 0);
+                        armed_due = due;
+                    }
+                    break;
+                }
+                BenchConn* c = &conns[next_conn++ % conns.size()];
+                while (c->fd < 0) c = &conns[next_conn++ % conns.size()];
+                submit(*c, due);
+                ++scheduled;
+                if (alive == 0) break;
+            }
+        }
+
+        int nfds = epoll_wait(epfd, events, MAX_EVENTS, -1);
+        if (nfds < 0) {
+            if (errno == EINTR) continue;
+            perror("epoll_wait");
+            break;
+        }
+
+        for (int i = 0; i < nfds; ++i) {
+            if (events[i].data.u64 == TIMER_ID) {
+                timers.expire([](uint64_t) {});
+                continue;
+            }
+            BenchConn& c = conns[events[i].data.u64];
+            if (c.fd < 0) continue;
+
+            if (events[i].events & EPOLLIN) {
+                bool closed = false;
+                char buf[BUFFER_SIZE];
+                while (true) {
+                    ssize_t n = recv(c.fd, buf, sizeof(buf), 0);
+                    if (n > 0) {
+                        c.in.append(buf, n);
+                    } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                        break;
+                    } else {
+                        closed = true;
+                        break;
+                    }
+                }
+
+                uint64_t received = monotonic_ns();
+                size_t consumed = 0;
+                if (binary_) {
+                    protocol::Response response;
+                    while (size_t size = protocol::parse_response(std::string_view(c.in).substr(consumed), response)) {
+                        consumed += size;
+                        auto it = std::find_if(c.inflight.begin(), c.inflight.end(),
+                                               [&](const Outstanding& o) { return o.id == response.request_id; });
+                        if (it == c.inflight.end()) {
+                            ++totals.mismatched;
+                            continue;
+                        }
+                        Outstanding request = *it;
+                        c.inflight.erase(it);
+                        complete(c, request, check_binary(pool[request.expr], response), received);
+                    }
+                } else {
+                    size_t pos;
+                    while ((pos = c.in.find('\n', consumed)) != std::string::npos && !c.inflight.empty()) {
+                        std::string_view line(c.in.data() + consumed, pos - consumed);
+                        Outstanding request = c.inflight.front();
+                        c.inflight.pop_front();
+                        bool ok = check_text(pool[request.expr], line);
+                        consumed = pos + 1;
+                        complete(c, request, ok, received);
+                    }
+                }
+                c.in.erase(0, consumed);
+
+                if (closed) {
+                    fputs("Connection closed by server\n", stderr);
+                    drop(c);
+                }
+                if (c.fd < 0) continue;
+            }
+
+            if (events[i].events & (EPOLLERR | EPOLLHUP | EPOLLRDHUP)) {
+                fputs("Connection closed or error\n", stderr);
+                drop(c);
+                continue;
+            }
+            if (events[i].events & EPOLLOUT) flush(c);
+        }
+    }
+
+    for (BenchConn& c : conns) {
+        totals.in_flight += c.inflight.size();
+        if (c.fd >= 0) close(c.fd);
+    }
+    close(epfd);
+}
+
+void Benchmark::report(const BenchmarkTotals& totals) {
+    const bool open_loop = options_.rate > 0;
+    const LatencyHistogram& latency = totals.latency;
+    double throughput = latency.count() / options_.duration;
+    std::string mode = open_loop ? "open-loop at " + std::to_string(static_cast<uint64_t>(options_.rate)) + " req/s"
+                                 : std::string("closed-loop");
+
+    std::cout << "Benchmark:  " << mode << ", " << totals.connections << " connections, " << load_.threads
+              << " threads, " << n_ << " operands, "
+              << (binary_ ? "binary" : "text") << " protocol\n";
+    std::printf("Duration:   %.2f s after %.2f s warmup\n", options_.duration, options_.warmup);
+    std::cout << "Requests:   " << latency.count() << " completed, " << totals.mismatched << " mismatched, "
+              << totals.failed << " failed, " << totals.in_flight << " in flight at end\n";
+    std::printf("Throughput: %.1f req/s\n\n", throughput);
+    std::printf("  %-10s %12s\n", "latency", "us");
+    for (size_t i = 0; i < std::size(kPercentiles); ++i) {
+        std::printf("  %-10s %12s\n", kPercentileNames[i], format_us(latency.percentile(kPercentiles[i])).c_str());
+    }
+    std::printf("  %-10s %12s\n", "max", format_us(latency.max()).c_str());
+    std::fflush(stdout);
+
+    if (options_.json_path.empty()) return;
+
+    std::string json = "{\"mode\":\"";
+    json += open_loop ? "open" : "closed";
+    json += "\",\"rate\":" + std::to_string(options_.rate);
+    json += ",\"connections\":" + std::to_string(totals.connections);
+    json += ",\"threads\":" + std::to_string(load_.threads);
+    json += ",\"operands\":" + std::to_string(n_);
+    json += ",\"protocol\":\"" + std::string(binary_ ? "binary" : "text") + "\"";
+    json += ",\"duration_s\":" + std::to_string(options_.duration);
+    json += ",\"warmup_s\":" + std::to_string(options_.warmup);
+    json += ",\"completed\":" + std::to_string(latency.count());
+    json += ",\"mismatched\":" + std::to_string(totals.mismatched);
+    json += ",\"failed\":" + std::to_string(totals.failed);
+    json += ",\"in_flight\":" + std::to_string(totals.in_flight);
+    json += ",\"throughput_rps\":" + std::to_string(throughput);
+    json += ",\"latency_us\":{";
+    for (size_t i = 0; i < std::size(kPercentiles); ++i) {
+        json += "\"" + std::string(kPercentileNames[i]) + "\":" + format_us(latency.percentile(kPercentiles[i])) + ",";
+    }
+    json += "\"max\":" + format_us(latency.max()) + "}}\n";
+
+    if (options_.json_path == "-") {
+        std::cout << json;
+    } else {
+        std::ofstream file(options_.json_path);
+        if (!file) throw std::runtime_error("Failed to open " + options_.json_path);
+        file << json;
+    }
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "LoadOptions.h"
+
+struct BenchmarkOptions {
+    // Measured seconds, after warmup seconds whose requests are discarded.
+    double duration = 10.0;
+    double warmup = 1.0;
+    // Requests per second over all connections (open loop); 0 runs closed
+    // loop, each connection sending its next request as soon as the
+    // previous one is answered.
+    double rate = 0.0;
+    // Also write the report as JSON to this file ("-" for stdout).
+    std::string json_path;
+};
+
+struct PooledExpression;
+struct BenchmarkTotals;
+
+// Load generator: keeps the connections open for the whole run and
+// reports throughput and latency percentiles instead of per-request lines.
+//
+// In open-loop mode requests are due at fixed intervals whether or not
+// earlier ones have been answered, and latency is measured from the time a
+// request was due rather than when it was actually written. A stalled
+// server therefore shows up in the percentiles instead of silently
+// lowering the offered load (coordinated omission).
+
+class Benchmark {
+public:
+    Benchmark(int n, int connections, const std::string& server_ip, int server_port, bool binary,
+              const BenchmarkOptions& options, const LoadOptions& load = LoadOptions{});
+    void run();
+
+private:
+    void run_loop(int thread, uint64_t start, const std::vector<PooledExpression>& pool, BenchmarkTotals& totals);
+    void report(const BenchmarkTotals& totals);
+
+    int n_;
+    int connections_;
+    std::string server_ip_;
+    int server_port_;
+    bool binary_;
+    BenchmarkOptions options_;
+    LoadOptions load_;
+};
@@ -5,6 +5,8 @@
 #include <limits>
 #include <cmath>
 
+#include "Rational.h"
+
 class ICalc {
 public:
     virtual ~ICalc() = default;
@@ -35,6 +37,16 @@ public:
         return result;
     }
 
+    // What a server running with --exact on computes for expr: the same
+    // checks as calculate(), then the value in int64 rationals. Returns
+    // false when an operand is not an integer or the value outgrows int64,
+    // in which case the server answers with the double result.
+    bool calculate_exact(const std::string& expr, Rational& out) {
+        calculate(expr);
+        size_t pos = 0;
+        return parse_exact_expression(expr, pos, out);
+    }
+
 private:
     void validate_characters(const std::string& expr) {
         for (char c : expr) {
@@ -110,6 +122,49 @@ private:
         return lhs;
     }
 
+    bool parse_exact_expression(const std::string& s, size_t& pos, Rational& lhs) {
+        if (!parse_exact_term(s, pos, lhs)) return false;
+        skip_spaces(s, pos);
+
+        while (pos < s.size()) {
+            char op = s[pos];
+            if (op != '+' && op != '-') break;
+
+            ++pos;
+            Rational rhs;
+            if (!parse_exact_term(s, pos, rhs)) return false;
+            if (!(op == '+' ? Rational::add(lhs, rhs) : Rational::sub(lhs, rhs))) return false;
+
+            skip_spaces(s, pos);
+        }
+
+        return true;
+    }
+
+    // Zero divisors never get here: calculate() has already thrown.
+    bool parse_exact_term(const std::string& s, size_t& pos, Rational& lhs) {
+        if (!Rational::from_double(parse_factor(s, pos), lhs)) return false;
+        skip_spaces(s, pos);
+
+        while (pos < s.size()) {
+            char op = s[pos];
+            if (op != '*' && op != '/' && op != '%') break;
+
+            ++pos;
+            Rational rhs;
+            if (!Rational::from_double(parse_factor(s, pos), rhs)) return false;
+
+            bool fits = op == '*'   ? Rational::mul(lhs, rhs)
+                        : op == '/' ? Rational::div(lhs, rhs)
+                                    : Rational::mod(lhs, rhs);
+            if (!fits) return false;
+
+            skip_spaces(s, pos);
+        }
+
+        return true;
+    }
+
     double parse_factor(const std::string& s, size_t& pos) {
         skip_spaces(s, pos);
         return parse_number(s, pos);
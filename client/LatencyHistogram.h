@@ -0,0 +1,69 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+// Log-linear histogram of latencies in nanoseconds, in the style of HDR
+// histograms: each power of two is split into 2^kSubBits buckets, so any
+// percentile read back is within 1/32 of a recorded value. The maximum is
+// kept exactly.
+class LatencyHistogram {
+public:
+    static constexpr unsigned kSubBits = 5;
+    static constexpr unsigned kMaxBits = 40;
+    static constexpr size_t kBuckets = (kMaxBits - kSubBits + 1) << kSubBits;
+
+    LatencyHistogram() : buckets_(kBuckets) {}
+
+    void record(uint64_t ns) {
+        ++buckets_[bucket_of(ns)];
+        ++count_;
+        max_ = std::max(max_, ns);
+    }
+
+    void merge(const LatencyHistogram& other) {
+        for (size_t i = 0; i < kBuckets; ++i) buckets_[i] += other.buckets_[i];
+        count_ += other.count_;
+        max_ = std::max(max_, other.max_);
+    }
+
+    uint64_t count() const { return count_; }
+    uint64_t max() const { return max_; }
+
+    // Smallest recorded value v (rounded up to its bucket) such that at
+    // least percent% of the samples are <= v.
+    uint64_t percentile(double percent) const {
+        if (count_ == 0) return 0;
+        uint64_t rank = static_cast<uint64_t>(std::ceil(percent / 100.0 * count_));
+        rank = std::clamp<uint64_t>(rank, 1, count_);
+
+        uint64_t seen = 0;
+        for (size_t i = 0; i < kBuckets; ++i) {
+            seen += buckets_[i];
+            if (seen >= rank) return std::min(upper_bound(i), max_);
+        }
+        return max_;
+    }
+
+private:
+    static size_t bucket_of(uint64_t ns) {
+        if (ns < (uint64_t{1} << kSubBits)) return ns;
+        if (ns >= (uint64_t{1} << kMaxBits)) return kBuckets - 1;
+        unsigned exponent = 63 - __builtin_clzll(ns);
+        size_t sub = (ns >> (exponent - kSubBits)) & ((1u << kSubBits) - 1);
+        return ((exponent - kSubBits + 1) << kSubBits) + sub;
+    }
+
+    static uint64_t upper_bound(size_t bucket) {
+        if (bucket < (size_t{1} << kSubBits)) return bucket;
+        unsigned shift = static_cast<unsigned>(bucket >> kSubBits) - 1;
+        uint64_t sub = bucket & ((1u << kSubBits) - 1);
+        return (((uint64_t{1} << kSubBits) + sub + 1) << shift) - 1;
+    }
+
+    std::vector<uint64_t> buckets_;
+    uint64_t count_ = 0;
+    uint64_t max_ = 0;
+};
@@ -0,0 +1,15 @@
+#pragma once
+
+#include "Socket.h"
+
+// How the connections of a run are spread and their responses checked, in
+// both the one-shot and the benchmark mode.
+struct LoadOptions {
+    // Event loops, each on its own thread with its own epoll instance and
+    // an equal share of the connections.
+    int threads = 1;
+    SourceRange sources;
+    // The server runs with --exact on: results that are exact rationals
+    // must match to the last digit instead of within rounding.
+    bool exact = false;
+};
@@ -0,0 +1,142 @@
+#pragma once
+
+#include <charconv>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <numeric>
+
+// Exact rational with int64 numerator and denominator, kept in lowest
+// terms with den > 0. A result that does not fit is reported instead of
+// wrapped, so callers can fall back to double. Common factors are cancelled
+// before multiplying, which keeps the arithmetic in 64 bits; only sums whose
+// intermediates overflow, and mod(), go through 128. Integers (den == 1),
+// which is what most expressions consist of, need just the overflow
+// builtins.
+//
+// The client keeps an identical copy to predict exact responses.
+struct Rational {
+    int64_t num = 0;
+    int64_t den = 1;
+
+    // Longest format_2dp() output: sign, 19 integer digits, point and two
+    // decimals.
+    static constexpr size_t kMaxFormatted = 1 + 19 + 1 + 2;
+
+    // Accepts integral values up to 2^53 in magnitude, the range in which
+    // a double holds every integer.
+    static bool from_double(double v, Rational& out) {
+        if (!(std::fabs(v) <= 9007199254740992.0) || v != std::trunc(v)) return false;
+        out.num = static_cast<int64_t>(v);
+        out.den = 1;
+        return true;
+    }
+
+    double to_double() const {
+        if (den == 1) return static_cast<double>(num);
+        return static_cast<double>(num) / static_cast<double>(den);
+    }
+
+    // lhs op= rhs. Each returns false when the result does not fit, leaving
+    // lhs unspecified. div() and mod() expect a non-zero rhs; mod() has
+    // fmod's sign rule, x - y * trunc(x / y).
+    static bool add(Rational& lhs, const Rational& rhs) {
+        if (lhs.den == 1 && rhs.den == 1) return !__builtin_add_overflow(lhs.num, rhs.num, &lhs.num);
+        return add_fraction(lhs, rhs.num, rhs.den);
+    }
+
+    static bool sub(Rational& lhs, const Rational& rhs) {
+        if (lhs.den == 1 && rhs.den == 1) return !__builtin_sub_overflow(lhs.num, rhs.num, &lhs.num);
+        return rhs.num != INT64_MIN && add_fraction(lhs, -rhs.num, rhs.den);
+    }
+
+    static bool mul(Rational& lhs, const Rational& rhs) {
+        if (lhs.den == 1 && rhs.den == 1) return !__builtin_mul_overflow(lhs.num, rhs.num, &lhs.num);
+        // Cancelling across first leaves the product in lowest terms.
+        int64_t g1 = static_cast<int64_t>(std::gcd(magnitude(lhs.num), static_cast<uint64_t>(rhs.den)));
+        int64_t g2 = static_cast<int64_t>(std::gcd(magnitude(rhs.num), static_cast<uint64_t>(lhs.den)));
+        return !__builtin_mul_overflow(lhs.num / g1, rhs.num / g2, &lhs.num) &&
+               !__builtin_mul_overflow(lhs.den / g2, rhs.den / g1, &lhs.den);
+    }
+
+    static bool div(Rational& lhs, const Rational& rhs) {
+        if (rhs.num == INT64_MIN) return false;
+        Rational inverse{rhs.num < 0 ? -rhs.den : rhs.den, rhs.num < 0 ? -rhs.num : rhs.num};
+        return mul(lhs, inverse);
+    }
+
+    static bool mod(Rational& lhs, const Rational& rhs) {
+        if (lhs.den == 1 && rhs.den == 1) {
+            // INT64_MIN % -1 overflows; the remainder is 0 anyway.
+            lhs.num = rhs.num == -1 ? 0 : lhs.num % rhs.num;
+            return true;
+        }
+        __int128 c = wide(rhs.num) * lhs.den;
+        return reduce(wide(lhs.num) * rhs.den % c, wide(lhs.den) * rhs.den, lhs);
+    }
+
+    // Rounded to two decimals with halves away from zero, so the text is a
+    // function of the exact value alone; a result that rounds to zero has
+    // no sign. buf must hold kMaxFormatted bytes.
+    size_t format_2dp(char* buf) const {
+        unsigned __int128 d = static_cast<uint64_t>(den);
+        unsigned __int128 cents = (static_cast<unsigned __int128>(magnitude(num)) * 200 + d) / (2 * d);
+
+        size_t len = 0;
+        if (num < 0 && cents != 0) buf[len++] = '-';
+        auto res = std::to_chars(buf + len, buf + kMaxFormatted, static_cast<uint64_t>(cents / 100));
+        len = res.ptr - buf;
+        unsigned fraction = static_cast<unsigned>(cents % 100);
+        buf[len++] = '.';
+        buf[len++] = static_cast<char>('0' + fraction / 10);
+        buf[len++] = static_cast<char>('0' + fraction % 10);
+        return len;
+    }
+
+private:
+    static __int128 wide(int64_t v) { return v; }
+    static uint64_t magnitude(int64_t v) { return v < 0 ? 0 - static_cast<uint64_t>(v) : static_cast<uint64_t>(v); }
+
+    // lhs + n / d over the least common denominator. With both in lowest
+    // terms, a common factor of the sum can only come from gcd(lhs.den, d).
+    // Sums that overflow 64 bits on the way are redone in 128.
+    static bool add_fraction(Rational& lhs, int64_t n, int64_t d) {
+        int64_t g = static_cast<int64_t>(std::gcd(static_cast<uint64_t>(lhs.den), static_cast<uint64_t>(d)));
+        int64_t a, c, num, den;
+        if (__builtin_mul_overflow(lhs.num, d / g, &a) || __builtin_mul_overflow(n, lhs.den / g, &c) ||
+            __builtin_add_overflow(a, c, &num) || __builtin_mul_overflow(lhs.den, d / g, &den)) {
+            return reduce(wide(lhs.num) * d + wide(n) * lhs.den, wide(lhs.den) * d, lhs);
+        }
+        if (num == 0) {
+            lhs = Rational{};
+            return true;
+        }
+        int64_t h = static_cast<int64_t>(std::gcd(magnitude(num), static_cast<uint64_t>(g)));
+        lhs.num = num / h;
+        lhs.den = den / h;
+        return true;
+    }
+
+    // Stores n / d (d > 0) in lowest terms if it fits.
+    static bool reduce(__int128 n, __int128 d, Rational& out) {
+        unsigned __int128 un = n < 0 ? -static_cast<unsigned __int128>(n) : static_cast<unsigned __int128>(n);
+        unsigned __int128 ud = static_cast<unsigned __int128>(d);
+        unsigned __int128 g = gcd(un, ud);
+        un /= g;
+        ud /= g;
+        if (un > INT64_MAX || ud > INT64_MAX) return false;
+        out.num = n < 0 ? -static_cast<int64_t>(un) : static_cast<int64_t>(un);
+        out.den = static_cast<int64_t>(ud);
+        return true;
+    }
+
+    static unsigned __int128 gcd(unsigned __int128 a, unsigned __int128 b) {
+        while (a > UINT64_MAX || b > UINT64_MAX) {
+            if (b == 0) return a;
+            unsigned __int128 r = a % b;
+            a = b;
+            b = r;
+        }
+        return std::gcd(static_cast<uint64_t>(a), static_cast<uint64_t>(b));
+    }
+};
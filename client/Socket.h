@@ -0,0 +1,86 @@
+#pragma once
+
+#include <arpa/inet.h>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <string>
+#include <sys/socket.h>
+#include <unistd.h>
+
+inline int set_nonblocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    if (flags == -1) return -1;
+    return fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+// Inclusive range of local IPv4 addresses (host byte order) to spread
+// outgoing connections over. Every address of 127.0.0.0/8 is loopback, so
+// a single machine can use many of them to get past the ~28k ephemeral
+// ports available per source address. An empty range leaves the choice to
+// the kernel.
+struct SourceRange {
+    uint32_t first = 0;
+    uint32_t last = 0;
+
+    bool empty() const { return first == 0; }
+    uint32_t pick(size_t index) const { return first + static_cast<uint32_t>(index % (last - first + 1)); }
+};
+
+// Parses "A.B.C.D" or "A.B.C.D-A.B.C.E".
+inline bool parse_source_range(const std::string& text, SourceRange& range) {
+    size_t dash = text.find('-');
+    in_addr first{}, last{};
+    if (inet_pton(AF_INET, text.substr(0, dash).c_str(), &first) <= 0) return false;
+    last = first;
+    if (dash != std::string::npos && inet_pton(AF_INET, text.substr(dash + 1).c_str(), &last) <= 0) return false;
+
+    range.first = ntohl(first.s_addr);
+    range.last = ntohl(last.s_addr);
+    return range.first != 0 && range.first <= range.last;
+}
+
+// Starts a non-blocking connect to ip:port, from source (host byte order)
+// unless it is 0. Returns the socket, or -1 after reporting the failure.
+inline int connect_nonblocking(const std::string& ip, int port, uint32_t source = 0) {
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    if (inet_pton(AF_INET, ip.c_str(), &addr.sin_addr) <= 0) {
+        fprintf(stderr, "Invalid IP address\n");
+        return -1;
+    }
+
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        perror("socket");
+        return -1;
+    }
+    if (source != 0) {
+        // Without a port the kernel picks one at connect() time, per
+        // destination, instead of reserving it at bind() time.
+        int one = 1;
+        setsockopt(fd, IPPROTO_IP, IP_BIND_ADDRESS_NO_PORT, &one, sizeof(one));
+        sockaddr_in local{};
+        local.sin_family = AF_INET;
+        local.sin_addr.s_addr = htonl(source);
+        if (bind(fd, (sockaddr*)&local, sizeof(local)) < 0) {
+            perror("bind");
+            close(fd);
+            return -1;
+        }
+    }
+    if (set_nonblocking(fd) < 0) {
+        perror("set_nonblocking");
+        close(fd);
+        return -1;
+    }
+    if (connect(fd, (sockaddr*)&addr, sizeof(addr)) < 0 && errno != EINPROGRESS) {
+        perror("connect");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstdint>
+#include <ctime>
+#include <functional>
+#include <queue>
+#include <stdexcept>
+#include <sys/timerfd.h>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+inline uint64_t monotonic_ns() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000u + static_cast<uint64_t>(ts.tv_nsec);
+}
+
+// Deadlines for an epoll loop, served by one timerfd that is always armed
+// for the earliest entry. The loop adds fd() to its epoll set and calls
+// expire() when it becomes readable; nothing ever sleeps, so any number of
+// connections can wait on their own schedules.
+class TimerQueue {
+public:
+    TimerQueue() {
+        fd_ = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        if (fd_ < 0) throw std::runtime_error("Failed to create timerfd");
+    }
+    ~TimerQueue() { close(fd_); }
+
+    TimerQueue(const TimerQueue&) = delete;
+    TimerQueue& operator=(const TimerQueue&) = delete;
+
+    int fd() const { return fd_; }
+    bool empty() const { return heap_.empty(); }
+
+    // Calls back with key once CLOCK_MONOTONIC reaches due_ns.
+    void schedule(uint64_t due_ns, uint64_t key) {
+        heap_.emplace(due_ns, key);
+        if (armed_ns_ == 0 || due_ns < armed_ns_) arm(due_ns);
+    }
+
+    // Pops every entry that is due and hands its key to fn, which may
+    // schedule new entries.
+    template <typename Fn>
+    void expire(Fn&& fn) {
+        uint64_t expirations;
+        ssize_t n = read(fd_, &expirations, sizeof(expirations));
+        (void)n;
+        armed_ns_ = 0;
+
+        uint64_t now = monotonic_ns();
+        while (!heap_.empty() && heap_.top().first <= now) {
+            uint64_t key = heap_.top().second;
+            heap_.pop();
+            fn(key);
+        }
+        if (!heap_.empty() && (armed_ns_ == 0 || heap_.top().first < armed_ns_)) arm(heap_.top().first);
+    }
+
+private:
+    using Entry = std::pair<uint64_t, uint64_t>;
+
+    void arm(uint64_t due_ns) {
+        // A zero it_value would disarm the timer; anything in the past
+        // fires at once.
+        if (due_ns == 0) due_ns = 1;
+        itimerspec spec{};
+        spec.it_value.tv_sec = static_cast<time_t>(due_ns / 1000000000u);
+        spec.it_value.tv_nsec = static_cast<long>(due_ns % 1000000000u);
+        timerfd_settime(fd_, TFD_TIMER_ABSTIME, &spec, nullptr);
+        armed_ns_ = due_ns;
+    }
+
+    int fd_ = -1;
+    uint64_t armed_ns_ = 0;
+    std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> heap_;
+};
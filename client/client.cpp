@@ -1,48 +1,98 @@
 
 #include <iostream>
+#include <algorithm>
+#include <cmath>
+#include <deque>
 #include <map>
 #include <vector>
 #include <random>
 #include <unistd.h>
-#include <fcntl.h>
 #include <sys/epoll.h>
-#include <arpa/inet.h>
 #include <iomanip>
-#include <chrono>
+#include <sstream>
 #include <thread>
 
 #include "client.h"
 #include "Generator.h"
 #include "ICalc.h"
+#include "Protocol.h"
+#include "Socket.h"
+#include "TimerQueue.h"
 
 constexpr int MAX_EVENTS = 64;
 constexpr int BUFFER_SIZE = 4096;
 
+struct ClientStats {
+    uint64_t requests = 0;
+    uint64_t ok = 0;
+    uint64_t mismatched = 0;
+    uint64_t errors = 0;
+};
+
+// One stderr line, written with a single call when it goes out of scope so
+// that lines from different threads never interleave.
+class Line {
+public:
+    ~Line() {
+        out_ << '\n';
+        std::string text = out_.str();
+        ssize_t n = write(STDERR_FILENO, text.data(), text.size());
+        (void)n;
+    }
+
+    template <typename T>
+    Line& operator<<(const T& value) {
+        out_ << value;
+        return *this;
+    }
+
+private:
+    std::ostringstream out_;
+};
+
+// A request whose response has not been checked yet, with the result the
+// local evaluation expects for it.
+struct Expected {
+    uint32_t request_id;
+    std::string expr;
+    double value = 0.0;
+    // The response text an --exact server must send, when the result is an
+    // exact rational; empty otherwise.
+    std::string text;
+    bool error = false;
+};
+
 struct Conn {
     int fd;
     int id;
-    std::string expr;                 
+    // Requests sent or being sent, oldest first. Text responses come back
+    // in this order; binary ones are matched by request_id.
+    std::deque<Expected> expected;
+    uint32_t started = 0;
+    // Chunks of the request being sent.
     std::vector<std::string> chunks;
     size_t chunk_index = 0;
     size_t send_offset = 0;
     std::string recv_buffer;
-    bool finished_sending = false;
+    // Pausing between chunks; EPOLLOUT must not send ahead of the timer.
+    bool timer_pending = false;
 };
 
-static int set_nonblocking(int fd) {
-    int flags = fcntl(fd, F_GETFL, 0);
-    if (flags == -1) return -1;
-    return fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+// Timer keys carry the connection id along with the fd, so a timer that
+// outlives its connection cannot fire for a later one on the same fd.
+static uint64_t timer_key(const Conn& c) {
+    return (static_cast<uint64_t>(c.fd) << 32) | static_cast<uint32_t>(c.id);
 }
 
-static std::vector<std::string> split_expression_randomly(const std::string& expr, std::mt19937& rng) {
+static std::vector<std::string> split_expression_randomly(const std::string& expr, std::mt19937& rng,
+                                                         const PacingOptions& pacing) {
     std::vector<std::string> parts;
     size_t pos = 0;
 
     while (pos < expr.size()) {
         size_t remaining = expr.size() - pos;
-        size_t max_chunk = std::min<size_t>(4, remaining); 
-        std::uniform_int_distribution<size_t> dist(1, max_chunk); 
+        size_t max_chunk = std::min(pacing.max_chunk, remaining);
+        std::uniform_int_distribution<size_t> dist(std::min(pacing.min_chunk, max_chunk), max_chunk);
         size_t len = dist(rng);
 
         parts.emplace_back(expr.substr(pos, len));
@@ -52,8 +102,79 @@ static std::vector<std::string> split_expression_randomly(const std::string& exp
     return parts;
 }
 
+// The server rounds to two decimals itself, so a value exactly halfway
+// between may land on either side.
 static bool double_equal_2dp(double a, double b) {
-    return std::fabs(a - b) < 0.005;
+    return std::fabs(a - b) <= 0.005 + 1e-9 * std::max(1.0, std::fabs(a));
+}
+
+// Binary responses carry the unrounded double, so they should agree with
+// the local evaluation up to the last few bits.
+static bool double_equal_exact(double a, double b) {
+    return std::fabs(a - b) <= 1e-9 * std::max(1.0, std::fabs(a));
+}
+
+static void report_binary(Conn& c, const protocol::Response& response, ClientStats& stats) {
+    auto it = std::find_if(c.expected.begin(), c.expected.end(),
+                           [&](const Expected& e) { return e.request_id == response.request_id; });
+    if (it == c.expected.end()) {
+        Line() << "[Client #" << c.id << "] ERROR: response for request " << response.request_id;
+        ++stats.errors;
+        return;
+    }
+    Expected e = std::move(*it);
+    c.expected.erase(it);
+
+    if (response.status != 0) {
+        Line() << "[Client #" << c.id << "] ERROR: status " << int(response.status) << " for expr=" << e.expr;
+        ++stats.errors;
+    } else if (e.error) {
+        Line() << "[Client #" << c.id << "] ERROR: invalid response or calculation";
+        ++stats.errors;
+    } else if (e.text.empty() ? !double_equal_exact(e.value, response.value) : e.value != response.value) {
+        Line() << "[Client #" << c.id << "] MISMATCH: expr=" << e.expr
+               << " expected=" << std::setprecision(17) << e.value
+               << " got=" << response.value;
+        ++stats.mismatched;
+    } else {
+        Line() << "[Client #" << c.id << "] OK: expr=" << e.expr
+               << " result=" << std::setprecision(17) << response.value;
+        ++stats.ok;
+    }
+}
+
+// Checks one response line against the oldest outstanding request.
+static void report_text(Conn& c, const std::string& response_line, ClientStats& stats) {
+    if (c.expected.empty()) {
+        Line() << "[Client #" << c.id << "] ERROR: unexpected response " << response_line;
+        ++stats.errors;
+        return;
+    }
+    Expected e = std::move(c.expected.front());
+    c.expected.pop_front();
+
+    try {
+        if (e.error) throw std::runtime_error(e.expr);
+        double actual = std::stod(response_line);
+
+        if (!e.text.empty() && response_line != e.text) {
+            Line() << "[Client #" << c.id << "] MISMATCH: expr=" << e.expr << " expected=" << e.text
+                   << " got=" << response_line;
+            ++stats.mismatched;
+        } else if (!double_equal_2dp(e.value, actual)) {
+            Line() << "[Client #" << c.id << "] MISMATCH: expr=" << e.expr
+                   << " expected=" << std::fixed << std::setprecision(2) << e.value
+                   << " got=" << response_line;
+            ++stats.mismatched;
+        } else {
+            Line() << "[Client #" << c.id << "] OK: expr=" << e.expr
+                   << " result=" << std::fixed << std::setprecision(2) << actual;
+            ++stats.ok;
+        }
+    } catch (...) {
+        Line() << "[Client #" << c.id << "] ERROR: invalid response or calculation";
+        ++stats.errors;
+    }
 }
 
 static ssize_t send_all(int fd, const std::string& data, size_t& offset) {
@@ -64,10 +185,39 @@ static ssize_t send_all(int fd, const std::string& data, size_t& offset) {
     return sent;
 }
 
-Client::Client(int n, int connections, const std::string& server_ip, int server_port)
-    : n_(n), connections_(connections), server_ip_(server_ip), server_port_(server_port) {}
+Client::Client(int n, int connections, const std::string& server_ip, int server_port, bool binary,
+               const PacingOptions& pacing, const LoadOptions& load, const SessionOptions& session)
+    : n_(n), connections_(connections), server_ip_(server_ip), server_port_(server_port), binary_(binary),
+      pacing_(pacing), load_(load), session_(session) {}
 
 void Client::run() {
+    std::vector<ClientStats> stats(load_.threads);
+    std::vector<std::thread> threads;
+    for (int t = 1; t < load_.threads; ++t) {
+        threads.emplace_back([this, t, &stats] {
+            try {
+                run_loop(t, stats[t]);
+            } catch (const std::exception& e) {
+                Line() << "Thread error: " << e.what();
+            }
+        });
+    }
+    run_loop(0, stats[0]);
+    for (auto& thread : threads) thread.join();
+
+    ClientStats total;
+    for (const ClientStats& s : stats) {
+        total.requests += s.requests;
+        total.ok += s.ok;
+        total.mismatched += s.mismatched;
+        total.errors += s.errors;
+    }
+    std::cout << "Connections: " << connections_ << ", Requests: " << total.requests << ", OK: " << total.ok << ", MISMATCH: " << total.mismatched
+              << ", ERROR: " << total.errors << "\n";
+}
+
+// Serves every load_.threads-th connection, starting at thread.
+void Client::run_loop(int thread, ClientStats& stats) {
     Generator generator;
     CalcImpl evaluator;
 
@@ -79,51 +229,113 @@ void Client::run() {
 
     std::map<int, Conn> conns;
 
-    for (int i = 0; i < connections_; ++i) {
-        int sockfd = socket(AF_INET, SOCK_STREAM, 0);
-        if (sockfd < 0) {
-            perror("socket");
-            continue;
-        }
+    std::mt19937 rng(std::random_device{}());
+    std::uniform_int_distribution<unsigned> delay_dist(pacing_.min_delay_ms, pacing_.max_delay_ms);
+
+    TimerQueue timers;
+    epoll_event timer_ev{};
+    timer_ev.data.fd = timers.fd();
+    timer_ev.events = EPOLLIN;
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, timers.fd(), &timer_ev) < 0) {
+        perror("epoll_ctl timerfd");
+        close(epfd);
+        throw std::runtime_error("Failed to watch the timerfd");
+    }
 
-        sockaddr_in serv_addr{};
-        serv_addr.sin_family = AF_INET;
-        serv_addr.sin_port = htons(server_port_);
-        if (inet_pton(AF_INET, server_ip_.c_str(), &serv_addr.sin_addr) <= 0) {
-            std::cerr << "Invalid IP address\n";
-            close(sockfd);
-            continue;
+    const uint64_t deadline = monotonic_ns() + static_cast<uint64_t>(session_.duration * 1e9);
+
+    // Whether the session calls for another request right now.
+    auto can_start = [&](const Conn& c) {
+        if (c.expected.size() >= session_.depth) return false;
+        if (session_.requests > 0 && c.started >= session_.requests) return false;
+        return session_.duration <= 0 || monotonic_ns() < deadline;
+    };
+
+    auto start_next = [&](Conn& c) {
+        if (!can_start(c)) return false;
+        Expected e;
+        e.request_id = c.started++;
+        e.expr = generator.generate_expression(n_);
+        try {
+            Rational exact;
+            if (load_.exact && evaluator.calculate_exact(e.expr, exact)) {
+                char buf[Rational::kMaxFormatted];
+                e.text.assign(buf, exact.format_2dp(buf));
+                e.value = exact.to_double();
+            } else {
+                e.value = evaluator.calculate(e.expr);
+            }
+        } catch (...) {
+            e.error = true;
         }
 
-        if (set_nonblocking(sockfd) < 0) {
-            perror("set_nonblocking");
-            close(sockfd);
-            continue;
+        std::string wire;
+        if (binary_) {
+            if (e.request_id == 0) wire.assign(protocol::kBinaryPreface, sizeof(protocol::kBinaryPreface));
+            protocol::append_request(wire, e.request_id, 0, e.expr);
+        } else {
+            wire = e.expr + ' ';
         }
+        c.chunks = split_expression_randomly(wire, rng, pacing_);
+        c.chunk_index = 0;
+        c.send_offset = 0;
 
-        int res = connect(sockfd, (sockaddr*)&serv_addr, sizeof(serv_addr));
-        if (res < 0 && errno != EINPROGRESS) {
-            perror("connect");
-            close(sockfd);
-            continue;
+        Line() << "[Client #" << c.id << "] Expression: " << e.expr;
+        c.expected.push_back(std::move(e));
+        ++stats.requests;
+        return true;
+    };
+
+    // Sends chunks, starting new requests while the session and the
+    // pipeline depth allow, until the socket would block or the pacing
+    // calls for a pause. Returns false if the connection failed.
+    auto send_chunks = [&](Conn& c) {
+        while (c.chunk_index < c.chunks.size() || start_next(c)) {
+            ssize_t sent = send_all(c.fd, c.chunks[c.chunk_index], c.send_offset);
+            if (sent < 0) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK) return true;
+                perror("send");
+                return false;
+            }
+            if (c.send_offset < c.chunks[c.chunk_index].size()) continue;
+
+            c.chunk_index++;
+            c.send_offset = 0;
+            if (c.chunk_index == c.chunks.size() && !can_start(c)) break;
+
+            unsigned delay_ms = delay_dist(rng);
+            if (delay_ms > 0) {
+                c.timer_pending = true;
+                timers.schedule(monotonic_ns() + delay_ms * 1000000ull, timer_key(c));
+                return true;
+            }
         }
+        return true;
+    };
 
-        std::string expr = generator.generate_expression(n_);
-        std::string expr_to_send = expr + ' ';
-        std::string expr_for_check = expr;
+    auto finished = [&](const Conn& c) { return c.expected.empty() && !can_start(c); };
 
-        std::random_device rd;
-        std::mt19937 rng(rd());
+    // Requests still outstanding on a connection that goes away count as
+    // errors; so does a connection that never got to send one.
+    auto lose = [&](const Conn& c) { stats.errors += std::max<size_t>(1, c.expected.size()); };
+
+    auto drop = [&](std::map<int, Conn>::iterator it) {
+        close(it->first);
+        epoll_ctl(epfd, EPOLL_CTL_DEL, it->first, nullptr);
+        conns.erase(it);
+    };
+
+    for (int i = thread; i < connections_; i += load_.threads) {
+        uint32_t source = load_.sources.empty() ? 0 : load_.sources.pick(i);
+        int sockfd = connect_nonblocking(server_ip_, server_port_, source);
+        if (sockfd < 0) {
+            ++stats.errors;
+            continue;
+        }
 
         Conn c;
         c.fd = sockfd;
         c.id = i;
-        c.expr = expr_for_check;
-        c.chunks = split_expression_randomly(expr_to_send, rng);
-        c.chunk_index = 0;
-        c.send_offset = 0;
-        c.finished_sending = false;
-
         conns[sockfd] = std::move(c);
 
         epoll_event ev{};
@@ -133,10 +345,9 @@ void Client::run() {
             perror("epoll_ctl");
             close(sockfd);
             conns.erase(sockfd);
+            ++stats.errors;
             continue;
         }
-
-        std::cerr << "[Client #" << i << "] Expression: " << expr_for_check << "\n";
     }
 
     epoll_event events[MAX_EVENTS];
@@ -151,50 +362,37 @@ void Client::run() {
 
         for (int i = 0; i < nfds; ++i) {
             int fd = events[i].data.fd;
+            if (fd == timers.fd()) {
+                timers.expire([&](uint64_t key) {
+                    auto it = conns.find(static_cast<int>(key >> 32));
+                    if (it == conns.end() || it->second.id != static_cast<int>(key & 0xffffffff)) return;
+                    it->second.timer_pending = false;
+                    if (!send_chunks(it->second)) {
+                        lose(it->second);
+                        drop(it);
+                    } else if (finished(it->second)) {
+                        drop(it);
+                    }
+                });
+                continue;
+            }
+
             auto it = conns.find(fd);
             if (it == conns.end()) continue;
             Conn& c = it->second;
 
             if (events[i].events & (EPOLLERR | EPOLLHUP | EPOLLRDHUP)) {
-                std::cerr << "[Client #" << c.id << "] Connection closed or error\n";
-                close(fd);
-                epoll_ctl(epfd, EPOLL_CTL_DEL, fd, nullptr);
-                conns.erase(it);
+                Line() << "[Client #" << c.id << "] Connection closed or error";
+                lose(c);
+                drop(it);
                 continue;
             }
 
-            if ((events[i].events & EPOLLOUT) && !c.finished_sending) {
-                if (c.chunk_index < c.chunks.size()) {
-                    ssize_t sent = send_all(fd, c.chunks[c.chunk_index], c.send_offset);
-                    if (sent > 0) {
-                        if (c.send_offset == c.chunks[c.chunk_index].size()) {
-                            c.chunk_index++;
-                            c.send_offset = 0;
-                        }
-                    } else if (sent == -1 && (errno != EAGAIN && errno != EWOULDBLOCK)) {
-                        perror("send");
-                        close(fd);
-                        epoll_ctl(epfd, EPOLL_CTL_DEL, fd, nullptr);
-                        conns.erase(it);
-                        continue;
-                    }
-
-                    epoll_event ev_mod{};
-                    ev_mod.data.fd = fd;
-                    ev_mod.events = EPOLLIN | EPOLLET;
-                    if (c.chunk_index < c.chunks.size()) {
-                        std::this_thread::sleep_for(std::chrono::milliseconds(10));
-                        ev_mod.events |= EPOLLOUT;
-                    } else {
-                        c.finished_sending = true;
-                    }
-                    if (epoll_ctl(epfd, EPOLL_CTL_MOD, fd, &ev_mod) < 0) {
-                        perror("epoll_ctl MOD");
-                        close(fd);
-                        epoll_ctl(epfd, EPOLL_CTL_DEL, fd, nullptr);
-                        conns.erase(it);
-                        continue;
-                    }
+            if ((events[i].events & EPOLLOUT) && !c.timer_pending) {
+                if (!send_chunks(c)) {
+                    lose(c);
+                    drop(it);
+                    continue;
                 }
             }
 
@@ -217,41 +415,35 @@ void Client::run() {
                     }
                 }
 
+                protocol::Response response;
+                size_t consumed;
+                while (binary_ && (consumed = protocol::parse_response(c.recv_buffer, response)) > 0) {
+                    report_binary(c, response, stats);
+                    c.recv_buffer.erase(0, consumed);
+                }
+
                 size_t pos;
-                while ((pos = c.recv_buffer.find('\n')) != std::string::npos) {
+                while (!binary_ && (pos = c.recv_buffer.find('\n')) != std::string::npos) {
                     std::string response_line = c.recv_buffer.substr(0, pos);
                     c.recv_buffer.erase(0, pos + 1);
 
                     while (!response_line.empty() && std::isspace(response_line.back()))
                         response_line.pop_back();
-
-                    try {
-                        double expected = evaluator.calculate(c.expr);
-                        double actual = std::stod(response_line);
-
-                        if (!double_equal_2dp(expected, actual)) {
-                            std::cerr << "[Client #" << c.id << "] MISMATCH: expr=" << c.expr
-                                      << " expected=" << std::fixed << std::setprecision(2) << expected
-                                      << " got=" << response_line << "\n";
-                        } else {
-                            std::cerr << "[Client #" << c.id << "] OK: expr=" << c.expr
-                                      << " result=" << std::fixed << std::setprecision(2) << actual << "\n";
-                        }
-                    } catch (...) {
-                        std::cerr << "[Client #" << c.id << "] ERROR: invalid response or calculation\n";
-                    }
-
-                    close(fd);
-                    epoll_ctl(epfd, EPOLL_CTL_DEL, fd, nullptr);
-                    conns.erase(it);
-                    break;
+                    report_text(c, response_line, stats);
                 }
 
                 if (closed) {
-                    close(fd);
-                    epoll_ctl(epfd, EPOLL_CTL_DEL, fd, nullptr);
-                    conns.erase(it);
+                    if (!c.expected.empty()) lose(c);
+                    drop(it);
+                    continue;
+                }
+                // Answers free pipeline slots for the next requests.
+                if (!c.timer_pending && !send_chunks(c)) {
+                    lose(c);
+                    drop(it);
+                    continue;
                 }
+                if (finished(c)) drop(it);
             }
         }
     }
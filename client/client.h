@@ -1,14 +1,48 @@
 #pragma once
 
+#include <cstdint>
 #include <string>
 
+#include "LoadOptions.h"
+
+// How each expression is trickled to the server: it is cut into chunks of
+// a uniformly random size, with a uniformly random pause between chunks.
+// A zero delay sends the chunks back to back.
+struct PacingOptions {
+    size_t min_chunk = 1;
+    size_t max_chunk = 4;
+    unsigned min_delay_ms = 10;
+    unsigned max_delay_ms = 10;
+};
+
+// How long each connection stays open. It sends expressions one after
+// another, keeping up to depth of them unanswered, until it has sent
+// requests of them or duration seconds have passed, whichever comes first
+// (0 disables either limit). The default is one expression per connection.
+struct SessionOptions {
+    uint32_t requests = 1;
+    double duration = 0.0;
+    size_t depth = 1;
+};
+
+struct ClientStats;
+
 class Client {
 public:
-    Client(int n, int connections, const std::string& server_ip, int server_port);
+    // binary selects the length-prefixed protocol (see Protocol.h).
+    Client(int n, int connections, const std::string& server_ip, int server_port, bool binary = false,
+           const PacingOptions& pacing = PacingOptions{}, const LoadOptions& load = LoadOptions{},
+           const SessionOptions& session = SessionOptions{});
     void run();
 private:
+    void run_loop(int thread, ClientStats& stats);
+
     int n_;
     int connections_;
     std::string server_ip_;
     int server_port_;
+    bool binary_;
+    PacingOptions pacing_;
+    LoadOptions load_;
+    SessionOptions session_;
 };
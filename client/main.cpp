@@ -1,9 +1,128 @@
+#include "Benchmark.h"
 #include "client.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
+#include <string>
+#include <thread>
+
+static void usage(const char* prog) {
+    std::cerr << "Usage: " << prog << " <n> <connections> <server_addr> <server_port> [--binary] [--exact]"
+              << " [--requests K] [--session-sec SEC] [--depth D] [--threads N] [--source-addrs A.B.C.D[-A.B.C.E]]"
+              << " [--chunk-bytes MIN[-MAX]] [--chunk-delay-ms MIN[-MAX]]"
+              << " [--duration SEC] [--warmup SEC] [--rate REQ_PER_SEC] [--json FILE]\n";
+}
+
+// Parses "A" or "A-B" into an inclusive range.
+static bool parse_range(const char* text, unsigned long& lo, unsigned long& hi) {
+    char* end;
+    lo = std::strtoul(text, &end, 10);
+    if (end == text) return false;
+    hi = lo;
+    if (*end == '-') {
+        const char* rest = end + 1;
+        hi = std::strtoul(rest, &end, 10);
+        if (end == rest) return false;
+    }
+    return *end == '\0' && lo <= hi;
+}
 
 int main(int argc, char* argv[]) {
-    if (argc != 5) {
-        std::cerr << "Usage: " << argv[0] << " <n> <connections> <server_addr> <server_port>\n";
+    if (argc < 5) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    bool binary = false;
+    bool benchmark = false;
+    BenchmarkOptions bench;
+    PacingOptions pacing;
+    LoadOptions load;
+    SessionOptions session;
+    bool requests_given = false;
+    try {
+        for (int i = 5; i < argc; ++i) {
+            if (std::strcmp(argv[i], "--binary") == 0) {
+                binary = true;
+                continue;
+            }
+            if (std::strcmp(argv[i], "--exact") == 0) {
+                load.exact = true;
+                continue;
+            }
+            if (i + 1 >= argc) {
+                usage(argv[0]);
+                return 1;
+            }
+            if (std::strcmp(argv[i], "--requests") == 0) {
+                session.requests = std::stoul(argv[++i]);
+                requests_given = true;
+                continue;
+            }
+            if (std::strcmp(argv[i], "--session-sec") == 0) {
+                session.duration = std::stod(argv[++i]);
+                continue;
+            }
+            if (std::strcmp(argv[i], "--depth") == 0) {
+                session.depth = std::stoul(argv[++i]);
+                continue;
+            }
+            if (std::strcmp(argv[i], "--threads") == 0) {
+                // 0 means one thread per CPU.
+                load.threads = std::stoi(argv[++i]);
+                if (load.threads == 0) load.threads = std::max(1u, std::thread::hardware_concurrency());
+                if (load.threads < 0) {
+                    std::cerr << "Invalid thread count: " << argv[i] << "\n";
+                    return 1;
+                }
+                continue;
+            }
+            if (std::strcmp(argv[i], "--source-addrs") == 0) {
+                if (!parse_source_range(argv[++i], load.sources)) {
+                    std::cerr << "Invalid source address range: " << argv[i] << "\n";
+                    return 1;
+                }
+                continue;
+            }
+            unsigned long lo, hi;
+            if (std::strcmp(argv[i], "--chunk-bytes") == 0) {
+                if (!parse_range(argv[++i], lo, hi) || lo == 0) {
+                    std::cerr << "Invalid chunk size: " << argv[i] << "\n";
+                    return 1;
+                }
+                pacing.min_chunk = lo;
+                pacing.max_chunk = hi;
+                continue;
+            }
+            if (std::strcmp(argv[i], "--chunk-delay-ms") == 0) {
+                if (!parse_range(argv[++i], lo, hi)) {
+                    std::cerr << "Invalid chunk delay: " << argv[i] << "\n";
+                    return 1;
+                }
+                pacing.min_delay_ms = lo;
+                pacing.max_delay_ms = hi;
+                continue;
+            }
+
+            // Any benchmark option switches from the one-shot check to a
+            // timed load run.
+            benchmark = true;
+            if (std::strcmp(argv[i], "--duration") == 0) {
+                bench.duration = std::stod(argv[++i]);
+            } else if (std::strcmp(argv[i], "--warmup") == 0) {
+                bench.warmup = std::stod(argv[++i]);
+            } else if (std::strcmp(argv[i], "--rate") == 0) {
+                bench.rate = std::stod(argv[++i]);
+            } else if (std::strcmp(argv[i], "--json") == 0) {
+                bench.json_path = argv[++i];
+            } else {
+                std::cerr << "Unknown option: " << argv[i] << "\n";
+                return 1;
+            }
+        }
+    } catch (const std::exception&) {
+        std::cerr << "Invalid option value\n";
         return 1;
     }
 
@@ -16,10 +135,24 @@ int main(int argc, char* argv[]) {
         std::cerr << "Invalid input parameters\n";
         return 1;
     }
+    // A session bounded by time alone sends as many requests as it can.
+    if (session.duration > 0 && !requests_given) session.requests = 0;
+    if (session.depth == 0 || session.duration < 0 || (session.requests == 0 && session.duration == 0)) {
+        std::cerr << "Invalid session parameters\n";
+        return 1;
+    }
+    if (bench.duration <= 0 || bench.warmup < 0 || bench.rate < 0) {
+        std::cerr << "Invalid benchmark parameters\n";
+        return 1;
+    }
 
     try {
-        Client client(n, connections, server_ip, server_port);
-        client.run();
+        if (benchmark) {
+            Benchmark(n, connections, server_ip, server_port, binary, bench, load).run();
+        } else {
+            Client client(n, connections, server_ip, server_port, binary, pacing, load, session);
+            client.run();
+        }
     } catch (const std::exception& ex) {
         std::cerr << "Fatal error: " << ex.what() << "\n";
         return 1;
@@ -0,0 +1,94 @@
+#include "AdminServer.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "Metrics.h"
+#include "Socket.h"
+
+namespace {
+
+constexpr size_t kMaxRequest = 4096;
+
+bool write_all(int fd, std::string_view data) {
+    while (!data.empty()) {
+        ssize_t n = send(fd, data.data(), data.size(), MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        data.remove_prefix(n);
+    }
+    return true;
+}
+
+std::string http_response(const char* status, std::string_view content_type, std::string_view body) {
+    std::string out = "HTTP/1.1 ";
+    out += status;
+    out += "\r\nContent-Type: ";
+    out += content_type;
+    out += "\r\nContent-Length: ";
+    out += std::to_string(body.size());
+    out += "\r\nConnection: close\r\n\r\n";
+    out += body;
+    return out;
+}
+
+}
+
+AdminServer::AdminServer(int port) {
+    listen_fd_ = create_listener(port, false, false, INADDR_LOOPBACK);
+    thread_ = std::thread([this] { serve(); });
+    std::cout << "Metrics on http://127.0.0.1:" << port << "/metrics\n";
+}
+
+AdminServer::~AdminServer() {
+    stop_.store(true, std::memory_order_release);
+    // Wakes the thread blocked in accept().
+    shutdown(listen_fd_, SHUT_RDWR);
+    thread_.join();
+    close(listen_fd_);
+}
+
+void AdminServer::serve() {
+    while (!stop_.load(std::memory_order_acquire)) {
+        int fd = accept(listen_fd_, nullptr, nullptr);
+        if (fd < 0) {
+            if (errno != EINTR && !stop_.load(std::memory_order_acquire)) perror("admin accept");
+            continue;
+        }
+        handle(fd);
+        close(fd);
+    }
+}
+
+void AdminServer::handle(int fd) {
+    // A client that never finishes its request cannot hold up the next one
+    // for long.
+    timeval timeout{1, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    std::string request;
+    char buf[1024];
+    while (request.size() < kMaxRequest && request.find("\r\n\r\n") == std::string::npos) {
+        ssize_t n = recv(fd, buf, sizeof(buf), 0);
+        if (n <= 0) break;
+        request.append(buf, n);
+    }
+
+    std::string_view line(request);
+    line = line.substr(0, line.find("\r\n"));
+    if (line.compare(0, 13, "GET /metrics ") == 0 || line == "GET /metrics") {
+        write_all(fd, http_response("200 OK", "text/plain; version=0.0.4; charset=utf-8",
+                                    MetricsRegistry::instance().render()));
+    } else {
+        write_all(fd, http_response("404 Not Found", "text/plain", "Not found\n"));
+    }
+}
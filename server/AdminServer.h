@@ -0,0 +1,24 @@
+#pragma once
+
+#include <atomic>
+#include <thread>
+
+// Serves GET /metrics over plain HTTP on a loopback port, from its own
+// thread, so scrapes never run on a reactor. Connections are handled one
+// at a time and closed after the response.
+class AdminServer {
+public:
+    explicit AdminServer(int port);
+    ~AdminServer();
+
+    AdminServer(const AdminServer&) = delete;
+    AdminServer& operator=(const AdminServer&) = delete;
+
+private:
+    void serve();
+    void handle(int fd);
+
+    int listen_fd_ = -1;
+    std::atomic<bool> stop_{false};
+    std::thread thread_;
+};
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <cstddef>
+#include <new>
+
+// Per-reactor allocator for connection buffers. Blocks come in power-of-two
+// size classes from kMinBlock to kMaxBlock; a released block goes onto its
+// class's free list and is handed to the next connection that needs one, so
+// connection churn reuses the same memory instead of fragmenting the heap.
+// Free blocks beyond kMaxCachedBytes, and blocks larger than kMaxBlock, go
+// straight back to the heap.
+//
+// Not thread-safe: a pool belongs to one reactor and only that reactor's
+// connections use it.
+class BlockPool {
+public:
+    static constexpr size_t kClasses = 9;
+    static constexpr size_t kMinBlock = 4096;
+    static constexpr size_t kMaxBlock = kMinBlock << (kClasses - 1);
+    static constexpr size_t kMaxCachedBytes = size_t{8} << 20;
+
+    struct Stats {
+        size_t blocks_in_use = 0;
+        size_t bytes_in_use = 0;
+        size_t blocks_cached = 0;
+        size_t bytes_cached = 0;
+    };
+
+    BlockPool() = default;
+    BlockPool(const BlockPool&) = delete;
+    BlockPool& operator=(const BlockPool&) = delete;
+    ~BlockPool() {
+        for (FreeBlock*& head : free_) {
+            while (head) {
+                FreeBlock* next = head->next;
+                ::operator delete(head);
+                head = next;
+            }
+        }
+    }
+
+    // The block size acquire() hands out for a request of size bytes.
+    static size_t block_size(size_t size) {
+        size_t block = kMinBlock;
+        while (block < size) block *= 2;
+        return block;
+    }
+
+    // size must come from block_size().
+    char* acquire(size_t size) {
+        stats_.blocks_in_use++;
+        stats_.bytes_in_use += size;
+        if (size <= kMaxBlock) {
+            FreeBlock*& head = free_[class_of(size)];
+            if (head) {
+                FreeBlock* b = head;
+                head = b->next;
+                stats_.blocks_cached--;
+                stats_.bytes_cached -= size;
+                return reinterpret_cast<char*>(b);
+            }
+        }
+        return static_cast<char*>(::operator new(size));
+    }
+
+    void release(char* block, size_t size) {
+        stats_.blocks_in_use--;
+        stats_.bytes_in_use -= size;
+        if (size > kMaxBlock || stats_.bytes_cached + size > kMaxCachedBytes) {
+            ::operator delete(block);
+            return;
+        }
+        FreeBlock*& head = free_[class_of(size)];
+        head = new (block) FreeBlock{head};
+        stats_.blocks_cached++;
+        stats_.bytes_cached += size;
+    }
+
+    const Stats& stats() const { return stats_; }
+
+private:
+    struct FreeBlock {
+        FreeBlock* next;
+    };
+
+    static size_t class_of(size_t size) { return __builtin_ctzll(size / kMinBlock); }
+
+    FreeBlock* free_[kClasses] = {};
+    Stats stats_;
+};
+
+// Buffers with no pool attached (e.g. in tools and benchmarks) use the heap.
+inline char* acquire_block(BlockPool* pool, size_t size) {
+    return pool ? pool->acquire(size) : static_cast<char*>(::operator new(size));
+}
+
+inline void release_block(BlockPool* pool, char* block, size_t size) {
+    if (pool) {
+        pool->release(block, size);
+    } else {
+        ::operator delete(block);
+    }
+}
@@ -0,0 +1,270 @@
+#pragma once
+
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "CalcResult.h"
+#include "CharScan.h"
+#include "Rational.h"
+
+// An expression compiled to reverse Polish notation: a flat opcode stream
+// plus the constants consumed by its Push instructions, in order.
+//
+// The grammar has two precedence levels and no parentheses, so the compiler
+// needs at most one pending additive and one pending multiplicative
+// operator, and the evaluator never holds more than kMaxStackDepth values,
+// whatever the input length.
+//
+// Operators are emitted exactly when the recursive-descent evaluator used
+// to apply them. On a syntax error the compiler keeps the program for the
+// valid prefix, and execute() runs that prefix first, so a division by zero
+// that precedes the syntax error is still the error reported.
+class CalcProgram {
+public:
+    enum class Op : uint8_t { Push, Add, Sub, Mul, Div, Mod };
+
+    static constexpr size_t kMaxStackDepth = 3;
+
+    // Replaces the program with the compiled form of expr, which must
+    // already have passed character validation. Storage is reused, so
+    // recompiling into the same program does not allocate once it has
+    // grown to the expression size.
+    void compile(std::string_view expr) {
+        // Every instruction consumes at least one input byte, except for the
+        // final pending operator, so expr.size() + 1 slots always suffice.
+        if (code_.size() < expr.size() + 1) {
+            code_.resize(expr.size() + 1);
+            constants_.resize(expr.size() / 2 + 1);
+        }
+        Op* code = code_.data();
+        double* constant = constants_.data();
+        syntax_error_ = CalcResult::success(0.0);
+
+        size_t pos = 0;
+        Op pending_add = Op::Push;
+        Op pending_mul = Op::Push;
+
+        while (true) {
+            double value;
+            if (!parse_number(expr, pos, value)) break;
+            *code++ = Op::Push;
+            *constant++ = value;
+
+            if (pending_mul != Op::Push) {
+                *code++ = pending_mul;
+                pending_mul = Op::Push;
+            }
+
+            skip_spaces(expr, pos);
+            if (pos == expr.size()) break;
+
+            char c = expr[pos];
+            if (c == '*' || c == '/' || c == '%') {
+                pending_mul = c == '*' ? Op::Mul : (c == '/' ? Op::Div : Op::Mod);
+            } else if (c == '+' || c == '-') {
+                if (pending_add != Op::Push) *code++ = pending_add;
+                pending_add = c == '+' ? Op::Add : Op::Sub;
+            } else {
+                break;
+            }
+            ++pos;
+        }
+
+        if (syntax_error_ && pos != expr.size()) {
+            syntax_error_ = CalcResult::failure(CalcError::UnexpectedCharacters, pos);
+        }
+        if (syntax_error_ && pending_add != Op::Push) *code++ = pending_add;
+
+        code_size_ = code - code_.data();
+        constants_size_ = constant - constants_.data();
+    }
+
+    // Runs the program without recursion on a fixed-size stack.
+    CalcResult execute() const {
+        double stack[kMaxStackDepth];
+        size_t sp = 0;
+        const double* constant = constants_.data();
+
+        for (size_t i = 0; i < code_size_; ++i) {
+            Op op = code_[i];
+            if (op == Op::Push) {
+                stack[sp++] = *constant++;
+                continue;
+            }
+
+            double rhs = stack[--sp];
+            double& lhs = stack[sp - 1];
+            switch (op) {
+                case Op::Add:
+                    lhs += rhs;
+                    break;
+                case Op::Sub:
+                    lhs -= rhs;
+                    break;
+                case Op::Mul:
+                    lhs *= rhs;
+                    break;
+                case Op::Div:
+                    if (std::abs(rhs) < std::numeric_limits<double>::epsilon()) {
+                        return CalcResult::failure(CalcError::DivisionByZero);
+                    }
+                    lhs /= rhs;
+                    break;
+                case Op::Mod:
+                    if (std::abs(rhs) < std::numeric_limits<double>::epsilon()) {
+                        return CalcResult::failure(CalcError::ModuloByZero);
+                    }
+                    lhs = std::fmod(lhs, rhs);
+                    break;
+                case Op::Push:
+                    break;
+            }
+        }
+
+        if (!syntax_error_) return syntax_error_;
+        if (std::isinf(stack[0])) return CalcResult::failure(CalcError::Overflow);
+        return CalcResult::success(stack[0]);
+    }
+
+    // The same program over exact rationals, for when every constant is an
+    // integer (the usual case) and no value outgrows int64. Anything else
+    // falls back to execute(), so errors and their order are the same.
+    CalcResult execute_exact() const {
+        Rational stack[kMaxStackDepth];
+        size_t sp = 0;
+        const double* constant = constants_.data();
+
+        for (size_t i = 0; i < code_size_; ++i) {
+            Op op = code_[i];
+            if (op == Op::Push) {
+                if (!Rational::from_double(*constant++, stack[sp++])) return execute();
+                continue;
+            }
+
+            const Rational rhs = stack[--sp];
+            Rational& lhs = stack[sp - 1];
+            bool fits = true;
+            switch (op) {
+                case Op::Add:
+                    fits = Rational::add(lhs, rhs);
+                    break;
+                case Op::Sub:
+                    fits = Rational::sub(lhs, rhs);
+                    break;
+                case Op::Mul:
+                    fits = Rational::mul(lhs, rhs);
+                    break;
+                case Op::Div:
+                    if (rhs.num == 0) return CalcResult::failure(CalcError::DivisionByZero);
+                    fits = Rational::div(lhs, rhs);
+                    break;
+                case Op::Mod:
+                    if (rhs.num == 0) return CalcResult::failure(CalcError::ModuloByZero);
+                    fits = Rational::mod(lhs, rhs);
+                    break;
+                case Op::Push:
+                    break;
+            }
+            if (!fits) return execute();
+        }
+
+        if (!syntax_error_) return syntax_error_;
+        return CalcResult::success(stack[0]);
+    }
+
+    bool valid() const { return syntax_error_.ok(); }
+    size_t size() const { return code_size_; }
+    const Op* code() const { return code_.data(); }
+    const double* constants() const { return constants_.data(); }
+
+    // Human-readable listing, one instruction per line, e.g. "push 2".
+    std::string disassemble() const {
+        static constexpr const char* kNames[] = {"push", "add", "sub", "mul", "div", "mod"};
+        std::string out;
+        const double* constant = constants_.data();
+        for (size_t i = 0; i < code_size_; ++i) {
+            Op op = code_[i];
+            out += kNames[static_cast<size_t>(op)];
+            if (op == Op::Push) {
+                char buf[32];
+                auto res = std::to_chars(buf, buf + sizeof(buf), *constant++);
+                out += ' ';
+                out.append(buf, res.ptr);
+            }
+            out += '\n';
+        }
+        return out;
+    }
+
+private:
+    static bool is_digit(char c) { return c >= '0' && c <= '9'; }
+    static bool is_space(char c) { return c == ' ' || (c >= '\t' && c <= '\r'); }
+
+    static void skip_spaces(std::string_view s, size_t& pos) {
+        while (pos < s.size() && is_space(s[pos])) {
+            ++pos;
+        }
+    }
+
+    bool parse_number(std::string_view s, size_t& pos, double& out) {
+        skip_spaces(s, pos);
+
+        if (pos >= s.size()) {
+            syntax_error_ = CalcResult::failure(CalcError::ExpectedNumber, pos);
+            return false;
+        }
+
+        bool negative = false;
+        if (s[pos] == '-') {
+            negative = true;
+            ++pos;
+        }
+
+        if (pos >= s.size() || (!is_digit(s[pos]) && s[pos] != '.')) {
+            syntax_error_ = CalcResult::failure(CalcError::ExpectedDigit, pos);
+            return false;
+        }
+
+        // Short integer operands (the common case) are folded with SWAR;
+        // anything with a fraction or more than 8 digits goes to from_chars.
+        uint64_t digits;
+        size_t n = charscan::parse_digits8(s.data() + pos, s.size() - pos, digits);
+        if (n > 0 && n < 8 && (pos + n == s.size() || s[pos + n] != '.')) {
+            pos += n;
+            double value = static_cast<double>(digits);
+            out = negative ? -value : value;
+            return true;
+        }
+
+        size_t start = pos;
+        bool has_decimal = false;
+
+        while (pos < s.size() &&
+               (is_digit(s[pos]) || (!has_decimal && s[pos] == '.'))) {
+            if (s[pos] == '.') has_decimal = true;
+            ++pos;
+        }
+
+        // from_chars is locale-independent and does not allocate.
+        double value;
+        auto res = std::from_chars(s.data() + start, s.data() + pos, value);
+        if (res.ec != std::errc() || res.ptr != s.data() + pos) {
+            syntax_error_ = CalcResult::failure(CalcError::InvalidNumber, start);
+            return false;
+        }
+
+        out = negative ? -value : value;
+        return true;
+    }
+
+    std::vector<Op> code_;
+    std::vector<double> constants_;
+    size_t code_size_ = 0;
+    size_t constants_size_ = 0;
+    CalcResult syntax_error_;
+};
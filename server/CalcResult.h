@@ -0,0 +1,96 @@
+#pragma once
+
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include "Rational.h"
+
+enum class CalcError : uint8_t {
+    None,
+    EmptyExpression,
+    InvalidCharacter,
+    UnexpectedCharacters,
+    ExpectedNumber,
+    ExpectedDigit,
+    InvalidNumber,
+    DivisionByZero,
+    ModuloByZero,
+    Overflow,
+    ExpressionTooLong,
+};
+
+constexpr size_t kCalcErrorCount = static_cast<size_t>(CalcError::ExpressionTooLong) + 1;
+
+// Result of an evaluation: either a value or an error with enough detail to
+// rebuild the message (offending character or position). An exact
+// evaluation also carries the rational it computed, and value is its
+// nearest double.
+struct CalcResult {
+    double value = 0.0;
+    CalcError error = CalcError::None;
+    char character = 0;
+    uint32_t position = 0;
+    // den == 0 when the value is not exact.
+    Rational rational{0, 0};
+
+    bool ok() const { return error == CalcError::None; }
+    explicit operator bool() const { return ok(); }
+    bool exact() const { return rational.den != 0; }
+
+    static CalcResult success(double v) { return CalcResult{v, CalcError::None, 0, 0}; }
+    static CalcResult success(const Rational& r) {
+        CalcResult result = success(r.to_double());
+        result.rational = r;
+        return result;
+    }
+    static CalcResult failure(CalcError e, size_t pos = 0, char c = 0) {
+        return CalcResult{0.0, e, c, static_cast<uint32_t>(pos)};
+    }
+};
+
+inline const char* calc_error_message(CalcError error) {
+    switch (error) {
+        case CalcError::None: return "";
+        case CalcError::EmptyExpression: return "Empty expression";
+        case CalcError::InvalidCharacter: return "Invalid character: ";
+        case CalcError::UnexpectedCharacters: return "Unexpected characters at position ";
+        case CalcError::ExpectedNumber: return "Expected number";
+        case CalcError::ExpectedDigit: return "Expected digit or decimal point after minus";
+        case CalcError::InvalidNumber: return "Invalid number format";
+        case CalcError::DivisionByZero: return "Division by zero";
+        case CalcError::ModuloByZero: return "Modulo by zero";
+        case CalcError::Overflow: return "Arithmetic overflow";
+        case CalcError::ExpressionTooLong: return "Expression too long";
+    }
+    return "Unknown error";
+}
+
+// Writes the full error message into buf without allocating and returns its
+// length (truncated to size).
+inline size_t format_calc_error(const CalcResult& r, char* buf, size_t size) {
+    const char* base = calc_error_message(r.error);
+    size_t len = std::min(std::strlen(base), size);
+    std::memcpy(buf, base, len);
+
+    if (r.error == CalcError::InvalidCharacter && len < size) {
+        buf[len++] = r.character;
+    } else if (r.error == CalcError::UnexpectedCharacters) {
+        auto res = std::to_chars(buf + len, buf + size, r.position);
+        if (res.ec == std::errc()) len = res.ptr - buf;
+    }
+    return len;
+}
+
+[[noreturn]] inline void throw_calc_error(const CalcResult& r) {
+    char buf[96];
+    std::string message(buf, format_calc_error(r, buf, sizeof(buf)));
+    switch (r.error) {
+        case CalcError::EmptyExpression: throw std::invalid_argument(message);
+        case CalcError::Overflow: throw std::overflow_error(message);
+        default: throw std::runtime_error(message);
+    }
+}
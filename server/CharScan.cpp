@@ -0,0 +1,214 @@
+#include "CharScan.h"
+
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define CHARSCAN_X86 1
+#include <immintrin.h>
+#endif
+
+namespace charscan {
+
+namespace {
+
+struct AllowedTable {
+    bool allowed[256] = {};
+
+    constexpr AllowedTable() {
+        for (int c = '0'; c <= '9'; ++c) allowed[c] = true;
+        for (int c = '\t'; c <= '\r'; ++c) allowed[c] = true;
+        for (char c : {' ', '+', '-', '*', '/', '%', '.'}) allowed[static_cast<unsigned char>(c)] = true;
+    }
+};
+
+constexpr AllowedTable kAllowed;
+
+size_t find_invalid_scalar(const char* data, size_t size) {
+    for (size_t i = 0; i < size; ++i) {
+        if (!kAllowed.allowed[static_cast<unsigned char>(data[i])]) return i;
+    }
+    return size;
+}
+
+const char* find_byte_scalar(const char* data, size_t size, char c) {
+    for (size_t i = 0; i < size; ++i) {
+        if (data[i] == c) return data + i;
+    }
+    return nullptr;
+}
+
+#ifdef CHARSCAN_X86
+
+// The allowed set is five byte ranges: [\t,\r], ' ', '%', ['*','+'] and
+// ['-','9']. x lies in [lo, lo + span] iff min_u8(x - lo, span) == x - lo.
+inline __m128i in_range_sse2(__m128i x, char lo, char span) {
+    __m128i t = _mm_sub_epi8(x, _mm_set1_epi8(lo));
+    return _mm_cmpeq_epi8(_mm_min_epu8(t, _mm_set1_epi8(span)), t);
+}
+
+inline __m128i allowed_sse2(__m128i x) {
+    __m128i ws = _mm_or_si128(in_range_sse2(x, '\t', '\r' - '\t'), _mm_cmpeq_epi8(x, _mm_set1_epi8(' ')));
+    __m128i ops = _mm_or_si128(_mm_cmpeq_epi8(x, _mm_set1_epi8('%')), in_range_sse2(x, '*', 1));
+    return _mm_or_si128(_mm_or_si128(ws, ops), in_range_sse2(x, '-', '9' - '-'));
+}
+
+__attribute__((target("avx2")))
+inline __m256i in_range_avx2(__m256i x, char lo, char span) {
+    __m256i t = _mm256_sub_epi8(x, _mm256_set1_epi8(lo));
+    return _mm256_cmpeq_epi8(_mm256_min_epu8(t, _mm256_set1_epi8(span)), t);
+}
+
+__attribute__((target("avx2")))
+inline __m256i allowed_avx2(__m256i x) {
+    __m256i ws = _mm256_or_si256(in_range_avx2(x, '\t', '\r' - '\t'), _mm256_cmpeq_epi8(x, _mm256_set1_epi8(' ')));
+    __m256i ops = _mm256_or_si256(_mm256_cmpeq_epi8(x, _mm256_set1_epi8('%')), in_range_avx2(x, '*', 1));
+    return _mm256_or_si256(_mm256_or_si256(ws, ops), in_range_avx2(x, '-', '9' - '-'));
+}
+
+size_t find_invalid_sse2(const char* data, size_t size) {
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16) {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        unsigned bad = ~static_cast<unsigned>(_mm_movemask_epi8(allowed_sse2(x))) & 0xffffu;
+        if (bad) return i + __builtin_ctz(bad);
+    }
+    return i + find_invalid_scalar(data + i, size - i);
+}
+
+__attribute__((target("avx2")))
+size_t find_invalid_avx2(const char* data, size_t size) {
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32) {
+        __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+        unsigned bad = ~static_cast<unsigned>(_mm256_movemask_epi8(allowed_avx2(x)));
+        if (bad) return i + __builtin_ctz(bad);
+    }
+    return i + find_invalid_sse2(data + i, size - i);
+}
+
+const char* find_byte_sse2(const char* data, size_t size, char c) {
+    __m128i needle = _mm_set1_epi8(c);
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16) {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        unsigned hit = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(x, needle)));
+        if (hit) return data + i + __builtin_ctz(hit);
+    }
+    return find_byte_scalar(data + i, size - i, c);
+}
+
+__attribute__((target("avx2")))
+const char* find_byte_avx2(const char* data, size_t size, char c) {
+    __m256i needle = _mm256_set1_epi8(c);
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32) {
+        __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+        unsigned hit = static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(x, needle)));
+        if (hit) return data + i + __builtin_ctz(hit);
+    }
+    return find_byte_sse2(data + i, size - i, c);
+}
+
+#endif
+
+struct Kernels {
+    Isa isa;
+    size_t (*find_invalid)(const char*, size_t);
+    const char* (*find_byte)(const char*, size_t, char);
+};
+
+constexpr Kernels kScalar{Isa::Scalar, find_invalid_scalar, find_byte_scalar};
+#ifdef CHARSCAN_X86
+constexpr Kernels kSse2{Isa::Sse2, find_invalid_sse2, find_byte_sse2};
+constexpr Kernels kAvx2{Isa::Avx2, find_invalid_avx2, find_byte_avx2};
+#endif
+
+bool cpu_supports(Isa isa) {
+    switch (isa) {
+        case Isa::Scalar: return true;
+#ifdef CHARSCAN_X86
+        case Isa::Sse2: return __builtin_cpu_supports("sse2");
+        case Isa::Avx2: return __builtin_cpu_supports("avx2");
+#else
+        default: return false;
+#endif
+    }
+    return false;
+}
+
+const Kernels* kernels_for(Isa isa) {
+    switch (isa) {
+#ifdef CHARSCAN_X86
+        case Isa::Avx2: return &kAvx2;
+        case Isa::Sse2: return &kSse2;
+#endif
+        default: return &kScalar;
+    }
+}
+
+const Kernels* detect() {
+    __builtin_cpu_init();
+    for (Isa isa : {Isa::Avx2, Isa::Sse2}) {
+        if (cpu_supports(isa)) return kernels_for(isa);
+    }
+    return &kScalar;
+}
+
+const Kernels* g_kernels = detect();
+
+}
+
+size_t find_invalid(const char* data, size_t size) {
+    return g_kernels->find_invalid(data, size);
+}
+
+const char* find_byte(const char* data, size_t size, char c) {
+    return g_kernels->find_byte(data, size, c);
+}
+
+size_t parse_digits8(const char* p, size_t avail, uint64_t& value) {
+    uint64_t v;
+    if (avail >= 8) {
+        std::memcpy(&v, p, 8);
+    } else {
+        unsigned char tmp[8] = {};
+        std::memcpy(tmp, p, avail);
+        std::memcpy(&v, tmp, 8);
+    }
+
+    // A byte is a digit iff it survives both "- '0'" and "+ (0x7f - '9')"
+    // without its top bit set. Borrows and carries only travel upwards from
+    // a non-digit byte, so the lowest flagged byte is always exact.
+    uint64_t flagged = ((v - 0x3030303030303030ull) | (v + 0x4646464646464646ull)) & 0x8080808080808080ull;
+    size_t n = flagged ? static_cast<size_t>(__builtin_ctzll(flagged)) / 8 : 8;
+    if (n == 0) return 0;
+
+    // Left-pad the digit run with '0' bytes and fold 8 digits in three
+    // multiply steps.
+    if (n < 8) v = (v << (8 * (8 - n))) | (0x3030303030303030ull >> (8 * n));
+    v = ((v & 0x0f0f0f0f0f0f0f0full) * 2561) >> 8;
+    v = ((v & 0x00ff00ff00ff00ffull) * 6553601) >> 16;
+    value = ((v & 0x0000ffff0000ffffull) * 42949672960001ull) >> 32;
+    return n;
+}
+
+Isa active_isa() {
+    return g_kernels->isa;
+}
+
+const char* isa_name(Isa isa) {
+    switch (isa) {
+        case Isa::Scalar: return "scalar";
+        case Isa::Sse2: return "sse2";
+        case Isa::Avx2: return "avx2";
+    }
+    return "unknown";
+}
+
+bool select_isa(Isa isa) {
+    if (!cpu_supports(isa)) return false;
+    g_kernels = kernels_for(isa);
+    return true;
+}
+
+}
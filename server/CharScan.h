@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+// Byte-scanning kernels used by the calculator and the input framing.
+// Each kernel has a scalar, an SSE2 and an AVX2 implementation; the widest
+// one the CPU supports is picked at startup.
+namespace charscan {
+
+enum class Isa { Scalar, Sse2, Avx2 };
+
+// Index of the first byte that cannot appear in an expression (anything but
+// digits, "+-*/%." and whitespace), or size if the whole block is valid.
+size_t find_invalid(const char* data, size_t size);
+
+// First occurrence of c, or nullptr.
+const char* find_byte(const char* data, size_t size, char c);
+
+// Parses the run of ASCII digits at p (at most 8 and at most avail bytes)
+// with SWAR arithmetic. Returns the number of digits consumed.
+size_t parse_digits8(const char* p, size_t avail, uint64_t& value);
+
+Isa active_isa();
+const char* isa_name(Isa isa);
+
+// Forces a narrower implementation, e.g. to compare kernels in benchmarks.
+// Returns false if the CPU does not support the requested one.
+bool select_isa(Isa isa);
+
+}
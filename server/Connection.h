@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include <netinet/in.h>
+
+#include "InputBuffer.h"
+#include "OutputBuffer.h"
+#include "StreamingCalc.h"
+#include "TimerWheel.h"
+
+enum class WireProtocol : uint8_t { Unknown, Text, Binary };
+
+// Which deadline a connection is currently held to. None while it only
+// waits for offloaded results.
+enum class TimeoutReason : uint8_t { None, Idle, Header, Write };
+
+// Per-connection state shared by all I/O backends. Backends that need
+// extra bookkeeping derive from it.
+struct alignas(64) Connection {
+    uint64_t id = 0;
+    InputBuffer in_buf;
+    OutputBuffer out_buf;
+    char peer[24] = "";
+    WireProtocol protocol = WireProtocol::Unknown;
+    bool closing = false;
+    bool read_paused = false;
+
+    // Text expression whose delimiter has not arrived yet; only the bytes
+    // of an unfinished number stay in in_buf. Allocated for the expression
+    // it evaluates, so connections between requests don't carry it.
+    std::unique_ptr<StreamingCalc> stream;
+
+    // An oversized request being skipped: text input up to the next
+    // delimiter, or the remaining bytes of a binary frame.
+    bool discard_to_delimiter = false;
+    size_t discard_bytes = 0;
+
+    // Turn bookkeeping, see RequestProcessor::start_turn(). input_deferred
+    // is set when complete requests were left in in_buf for a later turn,
+    // and peer_closed when the peer's EOF is waiting behind them.
+    size_t turn_budget = 0;
+    bool input_deferred = false;
+    bool peer_closed = false;
+    bool ready_queued = false;
+
+    // Buffered bytes as last reported to RequestProcessor::update_flow().
+    size_t accounted_bytes = 0;
+
+    // Request latency bookkeeping: when the oldest unanswered input and the
+    // latest input were read, and responses queued since the last write.
+    uint64_t received_ns = 0;
+    uint64_t last_received_ns = 0;
+    uint32_t unrecorded_responses = 0;
+
+    // Timeout bookkeeping, see RequestProcessor::arm_timeout(). The timer
+    // may be scheduled earlier than deadline_ns; it is re-armed when it
+    // fires early.
+    TimerWheel::Node timer;
+    TimeoutReason timeout_reason = TimeoutReason::None;
+    uint64_t deadline_ns = 0;
+    // When the request still being received started: the read that brought
+    // its first byte, or the one that completed the previous request. Zero
+    // between requests.
+    uint64_t request_started_ns = 0;
+    uint64_t last_sent_ns = 0;
+
+    // Text protocol only: while an offloaded job is in flight, later
+    // responses wait here so the connection still sees them in request
+    // order. Binary responses carry request ids and skip the queue.
+    // pending_base is the sequence number of pending[pending_head].
+    struct PendingResponse {
+        bool ready = false;
+        std::string text;
+    };
+    std::vector<PendingResponse> pending;
+    size_t pending_head = 0;
+    uint64_t pending_base = 0;
+    size_t pending_bytes = 0;
+    // Binary requests still on the worker pool.
+    uint32_t binary_jobs = 0;
+
+    // Part of a request has arrived, but not all of it.
+    bool streaming() const { return stream && stream->active(); }
+    bool mid_request() const { return !in_buf.empty() || streaming() || discard_to_delimiter || discard_bytes > 0; }
+
+    // Closing and nothing left to produce or send.
+    bool finished() const { return closing && pending.empty() && binary_jobs == 0 && out_buf.empty(); }
+
+    size_t output_bytes() const { return out_buf.size() + pending_bytes; }
+    size_t buffered_bytes() const { return in_buf.size() + output_bytes(); }
+};
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Dense connection table indexed by fd. Storage grows in fixed chunks, so
+// slots never move and accepting a connection allocates nothing once the
+// chunk for its fd exists. Every slot carries a generation that is bumped
+// on open and on release; the (generation, fd) pair is what goes into
+// epoll_event.data.u64, so an event queued for a connection that has since
+// been closed (and whose fd may already be reused) is recognised as stale.
+template <typename T>
+class ConnectionTable {
+public:
+    static constexpr size_t kChunkSize = 1024;
+
+    static uint64_t make_id(int fd, uint32_t generation) {
+        return (static_cast<uint64_t>(generation) << 32) | static_cast<uint32_t>(fd);
+    }
+    static int fd_of(uint64_t id) { return static_cast<int>(id & 0xffffffffu); }
+
+    // Activates the slot for fd and returns its fresh id.
+    uint64_t open(int fd) {
+        Slot& slot = slot_for(fd);
+        ++slot.generation;
+        slot.active = true;
+        ++size_;
+        return make_id(fd, slot.generation);
+    }
+
+    void release(int fd) {
+        Slot* slot = existing(fd);
+        if (!slot || !slot->active) return;
+        slot->value = T{};
+        slot->active = false;
+        ++slot->generation;
+        --size_;
+    }
+
+    // Returns nullptr for unknown fds and for ids whose generation is stale.
+    T* find(uint64_t id) {
+        Slot* slot = existing(fd_of(id));
+        if (!slot || !slot->active || make_id(fd_of(id), slot->generation) != id) return nullptr;
+        return &slot->value;
+    }
+
+    T* get(int fd) {
+        Slot* slot = existing(fd);
+        return (slot && slot->active) ? &slot->value : nullptr;
+    }
+
+    uint64_t id_of(int fd) const {
+        const Slot& slot = chunks_[fd / kChunkSize][fd % kChunkSize];
+        return make_id(fd, slot.generation);
+    }
+
+    size_t size() const { return size_; }
+
+    template <typename F>
+    void for_each(F&& f) {
+        for (size_t c = 0; c < chunks_.size(); ++c) {
+            if (!chunks_[c]) continue;
+            for (size_t i = 0; i < kChunkSize; ++i) {
+                Slot& slot = chunks_[c][i];
+                if (slot.active) f(static_cast<int>(c * kChunkSize + i), slot.value);
+            }
+        }
+    }
+
+private:
+    struct alignas(64) Slot {
+        T value{};
+        uint32_t generation = 0;
+        bool active = false;
+    };
+
+    Slot* existing(int fd) {
+        if (fd < 0) return nullptr;
+        size_t c = static_cast<size_t>(fd) / kChunkSize;
+        if (c >= chunks_.size() || !chunks_[c]) return nullptr;
+        return &chunks_[c][static_cast<size_t>(fd) % kChunkSize];
+    }
+
+    Slot& slot_for(int fd) {
+        size_t c = static_cast<size_t>(fd) / kChunkSize;
+        if (c >= chunks_.size()) chunks_.resize(c + 1);
+        if (!chunks_[c]) chunks_[c] = std::make_unique<Slot[]>(kChunkSize);
+        return chunks_[c][static_cast<size_t>(fd) % kChunkSize];
+    }
+
+    std::vector<std::unique_ptr<Slot[]>> chunks_;
+    size_t size_ = 0;
+};
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <charconv>
+#include <cstddef>
+#include <cstring>
+
+#include "CalcResult.h"
+#include "Protocol.h"
+
+// Longest "%.2f" rendering of a finite double: sign, 309 integer digits,
+// point and two decimals.
+constexpr size_t kMaxFormattedDouble = 1 + 309 + 1 + 2;
+constexpr size_t kMaxResponseLine = 128 + kMaxFormattedDouble;
+
+// Fixed two-decimal formatting, identical to printf("%.2f") but without
+// locale lookups or stream state. buf must hold kMaxFormattedDouble bytes.
+inline size_t format_double_2dp(double val, char* buf) {
+    auto res = std::to_chars(buf, buf + kMaxFormattedDouble, val, std::chars_format::fixed, 2);
+    return res.ptr - buf;
+}
+
+// Renders the response line for a result ("<value>\n" or "Error: <msg>\n").
+// Exact results are rounded from their rational rather than the double.
+// buf must hold kMaxResponseLine bytes.
+inline size_t format_response(const CalcResult& r, char* buf) {
+    size_t len;
+    if (r) {
+        len = r.exact() ? r.rational.format_2dp(buf) : format_double_2dp(r.value, buf);
+    } else {
+        std::memcpy(buf, "Error: ", 7);
+        len = 7 + format_calc_error(r, buf + 7, kMaxResponseLine - 8);
+    }
+    buf[len++] = '\n';
+    return len;
+}
+
+constexpr size_t kMaxBinaryResponse = protocol::kResponseHeader + kMaxResponseLine;
+
+// Renders a binary response frame (see Protocol.h). buf must hold
+// kMaxBinaryResponse bytes.
+inline size_t format_binary_response(uint32_t request_id, const CalcResult& r, uint8_t flags, char* buf) {
+    size_t len = protocol::kResponseHeader;
+    uint8_t out_flags = 0;
+    if (flags & protocol::kWantText) {
+        len += format_response(r, buf + len) - 1;
+        out_flags |= protocol::kWantText;
+    }
+
+    protocol::put_u32(buf, static_cast<uint32_t>(len - protocol::kLengthSize));
+    protocol::put_u32(buf + 4, request_id);
+    buf[8] = static_cast<char>(r.error);
+    buf[9] = static_cast<char>(out_flags);
+    buf[10] = buf[11] = 0;
+    protocol::put_f64(buf + 12, r.ok() ? r.value : 0.0);
+    return len;
+}
@@ -1,151 +1,71 @@
 #pragma once
 
-#include <string>
-#include <stdexcept>
-#include <limits>
-#include <cmath>
+#include <cstddef>
+#include <string_view>
+
+#include "CalcProgram.h"
+#include "CalcResult.h"
+#include "CharScan.h"
 
 class ICalc {
 public:
     virtual ~ICalc() = default;
-    virtual double calculate(const std::string& expr) = 0;
-};
-
-class CalcImpl : public ICalc {
-public:
-    double calculate(const std::string& expr) override {
-        if (expr.empty()) {
-            throw std::invalid_argument("Empty expression");
-        }
-
-        validate_characters(expr);
-
-        size_t pos = 0;
-        double result = parse_expression(expr, pos);
-
-        skip_spaces(expr, pos);
-        if (pos != expr.size()) {
-            throw std::runtime_error("Unexpected characters at position " + std::to_string(pos));
-        }
 
-        if (std::isinf(result)) {
-            throw std::overflow_error("Arithmetic overflow");
-        }
-
-        return result;
-    }
-
-private:
-    void validate_characters(const std::string& expr) {
-        for (char c : expr) {
-            if (!std::isdigit(c) && c != '+' && c != '-' && c != '*' &&
-                c != '/' && c != '%' && c != '.' &&
-                !std::isspace(static_cast<unsigned char>(c))) {
-                throw std::runtime_error(std::string("Invalid character: ") + c);
-            }
-        }
-    }
+    // Non-throwing, allocation-free entry point.
+    virtual CalcResult try_calculate(std::string_view expr) noexcept = 0;
 
-    static void skip_spaces(const std::string& s, size_t& pos) {
-        while (pos < s.size() && std::isspace(static_cast<unsigned char>(s[pos]))) {
-            ++pos;
-        }
+    // Evaluates exprs[0..count) into results[0..count) in one call, so a
+    // caller with several expressions at hand pays for one dispatch.
+    virtual void try_calculate_batch(const std::string_view* exprs, size_t count, CalcResult* results) noexcept {
+        for (size_t i = 0; i < count; ++i) results[i] = try_calculate(exprs[i]);
     }
 
-    double parse_expression(const std::string& s, size_t& pos) {
-        double lhs = parse_term(s, pos);
-        skip_spaces(s, pos);
-
-        while (pos < s.size()) {
-            char op = s[pos];
-            if (op != '+' && op != '-') break;
-
-            ++pos;
-            double rhs = parse_term(s, pos);
-
-            if (op == '+') {
-                lhs += rhs;
-            } else {
-                lhs -= rhs;
-            }
-
-            skip_spaces(s, pos);
-        }
-
-        return lhs;
+    double calculate(std::string_view expr) {
+        CalcResult r = try_calculate(expr);
+        if (!r) throw_calc_error(r);
+        return r.value;
     }
+};
 
-    double parse_term(const std::string& s, size_t& pos) {
-        double lhs = parse_factor(s, pos);
-        skip_spaces(s, pos);
-
-        while (pos < s.size()) {
-            char op = s[pos];
-            if (op != '*' && op != '/' && op != '%') break;
-
-            ++pos;
-            double rhs = parse_factor(s, pos);
-
-            switch (op) {
-                case '*':
-                    lhs *= rhs;
-                    break;
-                case '/':
-                    if (std::abs(rhs) < std::numeric_limits<double>::epsilon()) {
-                        throw std::runtime_error("Division by zero");
-                    }
-                    lhs /= rhs;
-                    break;
-                case '%':
-                    if (std::abs(rhs) < std::numeric_limits<double>::epsilon()) {
-                        throw std::runtime_error("Modulo by zero");
-                    }
-                    lhs = std::fmod(lhs, rhs);
-                    break;
-            }
+// Two-stage engine: each expression is compiled into a scratch CalcProgram
+// whose storage is reused across calls, then executed. Final, so calls
+// through a CalcImpl are direct and the batch loop inlines the engine.
+// An exact engine evaluates over rationals where it can (see
+// CalcProgram::execute_exact()).
+class CalcImpl final : public ICalc {
+public:
+    explicit CalcImpl(bool exact = false) : exact_(exact) {}
 
-            skip_spaces(s, pos);
-        }
+    bool exact() const { return exact_; }
 
-        return lhs;
+    CalcResult try_calculate(std::string_view expr) noexcept override {
+        CalcResult r = compile(expr, program_);
+        if (!r) return r;
+        return exact_ ? program_.execute_exact() : program_.execute();
     }
 
-    double parse_factor(const std::string& s, size_t& pos) {
-        skip_spaces(s, pos);
-        return parse_number(s, pos);
+    void try_calculate_batch(const std::string_view* exprs, size_t count, CalcResult* results) noexcept override {
+        for (size_t i = 0; i < count; ++i) results[i] = CalcImpl::try_calculate(exprs[i]);
     }
 
-    double parse_number(const std::string& s, size_t& pos) {
-        skip_spaces(s, pos);
-
-        if (pos >= s.size()) {
-            throw std::runtime_error("Expected number");
-        }
-
-        bool negative = false;
-        if (s[pos] == '-') {
-            negative = true;
-            ++pos;
-        }
-
-        if (pos >= s.size() || (!std::isdigit(s[pos]) && s[pos] != '.')) {
-            throw std::runtime_error("Expected digit or decimal point after minus");
+    // Compiles expr into a program that can be kept, inspected and executed
+    // repeatedly. Returns the empty-input or invalid-character error, if any;
+    // syntax errors are reported by CalcProgram::execute().
+    static CalcResult compile(std::string_view expr, CalcProgram& program) {
+        if (expr.empty()) {
+            return CalcResult::failure(CalcError::EmptyExpression);
         }
 
-        size_t start = pos;
-        bool has_decimal = false;
-
-        while (pos < s.size() &&
-               (std::isdigit(s[pos]) || (!has_decimal && s[pos] == '.'))) {
-            if (s[pos] == '.') has_decimal = true;
-            ++pos;
+        size_t bad = charscan::find_invalid(expr.data(), expr.size());
+        if (bad != expr.size()) {
+            return CalcResult::failure(CalcError::InvalidCharacter, bad, expr[bad]);
         }
 
-        try {
-            double value = std::stod(s.substr(start, pos - start));
-            return negative ? -value : value;
-        } catch (...) {
-            throw std::runtime_error("Invalid number format");
-        }
+        program.compile(expr);
+        return CalcResult::success(0.0);
     }
+
+private:
+    bool exact_;
+    CalcProgram program_;
 };
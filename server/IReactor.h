@@ -0,0 +1,8 @@
+#pragma once
+
+// One event loop serving its own share of the connections.
+class IReactor {
+public:
+    virtual ~IReactor() = default;
+    virtual void run() = 0;
+};
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <cstddef>
+#include <cstring>
+#include <string_view>
+#include <utility>
+
+#include "BlockPool.h"
+#include "CharScan.h"
+
+// Per-connection receive buffer. recv() writes straight into the free space
+// after tail_, complete frames are handed out as views into the buffer and
+// consumed by advancing head_, and scan_ remembers how far the delimiter
+// search has already looked, so bytes that arrive in small pieces are never
+// scanned twice. Unconsumed bytes are moved to the front only when the free
+// space runs out, which keeps the per-byte cost amortised O(1).
+//
+// The storage is a block borrowed from the reactor's BlockPool, held only
+// while bytes are buffered: release_if_empty() gives it back, so an idle
+// connection holds no receive memory.
+//
+// Views returned by next_frame() stay valid until the next call to
+// prepare() or release_if_empty().
+class InputBuffer {
+public:
+    InputBuffer() = default;
+    InputBuffer(const InputBuffer&) = delete;
+    InputBuffer& operator=(const InputBuffer&) = delete;
+    InputBuffer(InputBuffer&& other) noexcept { swap(other); }
+    InputBuffer& operator=(InputBuffer&& other) noexcept {
+        InputBuffer tmp(std::move(other));
+        swap(tmp);
+        return *this;
+    }
+    ~InputBuffer() {
+        if (data_) release_block(pool_, data_, capacity_);
+    }
+
+    // Takes blocks from pool from now on; call while nothing is buffered.
+    void attach(BlockPool* pool) { pool_ = pool; }
+
+    // Returns a pointer to at least min_space writable bytes.
+    char* prepare(size_t min_space) {
+        if (capacity_ - tail_ < min_space) make_room(min_space);
+        return data_ + tail_;
+    }
+
+    size_t writable() const { return capacity_ - tail_; }
+
+    void commit(size_t n) { tail_ += n; }
+
+    // Extracts the next frame terminated by delim, without the delimiter.
+    bool next_frame(char delim, std::string_view& frame) {
+        const char* base = data_;
+        const char* hit = charscan::find_byte(base + scan_, tail_ - scan_, delim);
+        if (!hit) {
+            scan_ = tail_;
+            return false;
+        }
+
+        size_t pos = hit - base;
+        frame = std::string_view(base + head_, pos - head_);
+        head_ = scan_ = pos + 1;
+        if (head_ == tail_) head_ = scan_ = tail_ = 0;
+        return true;
+    }
+
+    // Hands out the next n buffered bytes as a frame, for protocols that
+    // know frame lengths up front. Requires size() >= n.
+    std::string_view take(size_t n) {
+        std::string_view frame(data_ + head_, n);
+        head_ += n;
+        if (scan_ < head_) scan_ = head_;
+        if (head_ == tail_) head_ = scan_ = tail_ = 0;
+        return frame;
+    }
+
+    std::string_view pending() const { return std::string_view(data_ + head_, tail_ - head_); }
+    size_t size() const { return tail_ - head_; }
+    bool empty() const { return head_ == tail_; }
+
+    void clear() { head_ = scan_ = tail_ = 0; }
+
+    // Returns the block to the pool when nothing is buffered.
+    void release_if_empty() {
+        if (!data_ || head_ != tail_) return;
+        release_block(pool_, data_, capacity_);
+        data_ = nullptr;
+        capacity_ = head_ = scan_ = tail_ = 0;
+    }
+
+private:
+    void make_room(size_t min_space) {
+        size_t used = tail_ - head_;
+        size_t needed = used + min_space;
+        if (needed <= capacity_) {
+            std::memmove(data_, data_ + head_, used);
+        } else {
+            size_t cap = BlockPool::block_size(needed);
+            char* grown = acquire_block(pool_, cap);
+            if (used) std::memcpy(grown, data_ + head_, used);
+            if (data_) release_block(pool_, data_, capacity_);
+            data_ = grown;
+            capacity_ = cap;
+        }
+        scan_ -= head_;
+        tail_ = used;
+        head_ = 0;
+    }
+
+    void swap(InputBuffer& other) noexcept {
+        std::swap(pool_, other.pool_);
+        std::swap(data_, other.data_);
+        std::swap(capacity_, other.capacity_);
+        std::swap(head_, other.head_);
+        std::swap(scan_, other.scan_);
+        std::swap(tail_, other.tail_);
+    }
+
+    BlockPool* pool_ = nullptr;
+    char* data_ = nullptr;
+    size_t capacity_ = 0;
+    size_t head_ = 0;
+    size_t scan_ = 0;
+    size_t tail_ = 0;
+};
@@ -0,0 +1,157 @@
+#include "IoUring.h"
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace {
+
+int sys_io_uring_setup(unsigned entries, io_uring_params* params) {
+    return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+}
+
+int sys_io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+    return static_cast<int>(syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0));
+}
+
+void* map_ring(int fd, size_t size, off_t offset) {
+    void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, offset);
+    if (p == MAP_FAILED) throw std::runtime_error("Failed to map io_uring: " + std::string(strerror(errno)));
+    return p;
+}
+
+template <typename T>
+T* at(void* base, unsigned offset) {
+    return reinterpret_cast<T*>(static_cast<char*>(base) + offset);
+}
+
+}
+
+IoUring::IoUring(unsigned entries) {
+    // Cooperative task running avoids an IPI per completion; kernels that
+    // predate it reject the flag, so retry without.
+    io_uring_params params{};
+    params.flags = IORING_SETUP_COOP_TASKRUN;
+    ring_fd_ = sys_io_uring_setup(entries, &params);
+    if (ring_fd_ < 0 && errno == EINVAL) {
+        params = io_uring_params{};
+        ring_fd_ = sys_io_uring_setup(entries, &params);
+    }
+    if (ring_fd_ < 0) throw std::runtime_error("io_uring_setup failed: " + std::string(strerror(errno)));
+    features_ = params.features;
+
+    sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_ring_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    if (features_ & IORING_FEAT_SINGLE_MMAP) {
+        if (cq_ring_size_ > sq_ring_size_) sq_ring_size_ = cq_ring_size_;
+        cq_ring_size_ = sq_ring_size_;
+    }
+
+    try {
+        sq_ring_ = map_ring(ring_fd_, sq_ring_size_, IORING_OFF_SQ_RING);
+        cq_ring_ = (features_ & IORING_FEAT_SINGLE_MMAP) ? sq_ring_ : map_ring(ring_fd_, cq_ring_size_, IORING_OFF_CQ_RING);
+        sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+        sqes_ = static_cast<io_uring_sqe*>(map_ring(ring_fd_, sqes_size_, IORING_OFF_SQES));
+    } catch (...) {
+        unmap();
+        throw;
+    }
+
+    sq_head_ = at<unsigned>(sq_ring_, params.sq_off.head);
+    sq_tail_ = at<unsigned>(sq_ring_, params.sq_off.tail);
+    sq_array_ = at<unsigned>(sq_ring_, params.sq_off.array);
+    sq_mask_ = *at<unsigned>(sq_ring_, params.sq_off.ring_mask);
+    sq_entries_ = params.sq_entries;
+    sqe_tail_ = submitted_ = *sq_tail_;
+
+    cq_head_ = at<unsigned>(cq_ring_, params.cq_off.head);
+    cq_tail_ = at<unsigned>(cq_ring_, params.cq_off.tail);
+    cq_mask_ = at<unsigned>(cq_ring_, params.cq_off.ring_mask);
+    cqes_ = at<io_uring_cqe>(cq_ring_, params.cq_off.cqes);
+}
+
+IoUring::~IoUring() {
+    unmap();
+}
+
+void IoUring::unmap() {
+    if (sqes_) munmap(sqes_, sqes_size_);
+    if (cq_ring_ && cq_ring_ != sq_ring_) munmap(cq_ring_, cq_ring_size_);
+    if (sq_ring_) munmap(sq_ring_, sq_ring_size_);
+    if (ring_fd_ != -1) close(ring_fd_);
+    sqes_ = nullptr;
+    cq_ring_ = sq_ring_ = nullptr;
+    ring_fd_ = -1;
+}
+
+io_uring_sqe* IoUring::get_sqe() {
+    while (sqe_tail_ - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE) >= sq_entries_) {
+        // Without SQPOLL the kernel consumes the submitted entries inside
+        // io_uring_enter() unless it refuses the call: -EINTR, or -EBUSY
+        // and -EAGAIN while completions back up. Until sq_head moves every
+        // slot still holds a queued entry, so clear the completion ring out
+        // of the way and try again.
+        int ret = enter(sqe_tail_ - submitted_, 0, 0);
+        if (ret >= 0 || ret == -EINTR) continue;
+        if (stash_completions() == 0) {
+            throw std::runtime_error("io_uring_enter failed: " + std::string(strerror(-ret)));
+        }
+    }
+
+    unsigned index = sqe_tail_ & sq_mask_;
+    io_uring_sqe* sqe = &sqes_[index];
+    std::memset(sqe, 0, sizeof(*sqe));
+    sq_array_[index] = index;
+    ++sqe_tail_;
+    return sqe;
+}
+
+int IoUring::submit_and_wait(unsigned wait_nr) {
+    if (!stashed_.empty()) wait_nr = 0;
+    return enter(sqe_tail_ - submitted_, wait_nr, wait_nr ? IORING_ENTER_GETEVENTS : 0);
+}
+
+int IoUring::enter(unsigned to_submit, unsigned wait_nr, unsigned flags) {
+    __atomic_store_n(sq_tail_, sqe_tail_, __ATOMIC_RELEASE);
+    int ret = sys_io_uring_enter(ring_fd_, to_submit, wait_nr, flags);
+    if (ret < 0) return -errno;
+    submitted_ += static_cast<unsigned>(ret);
+    return ret;
+}
+
+unsigned IoUring::stash_completions() {
+    unsigned head = *cq_head_;
+    unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+    for (unsigned i = head; i != tail; ++i) stashed_.push_back(cqes_[i & *cq_mask_]);
+    __atomic_store_n(cq_head_, tail, __ATOMIC_RELEASE);
+    return tail - head;
+}
+
+BufferPool::BufferPool(IoUring& ring, uint16_t group, unsigned count, unsigned buffer_size)
+    : ring_(ring), buffer_size_(buffer_size), group_(group) {
+    data_size_ = static_cast<size_t>(count) * buffer_size;
+    void* mem = mmap(nullptr, data_size_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) throw std::runtime_error("Failed to allocate receive buffers");
+    data_ = static_cast<char*>(mem);
+
+    provide(0, count);
+}
+
+BufferPool::~BufferPool() {
+    munmap(data_, data_size_);
+}
+
+void BufferPool::provide(uint16_t first, unsigned count) {
+    io_uring_sqe* sqe = ring_.get_sqe();
+    sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+    sqe->fd = static_cast<int>(count);
+    sqe->addr = reinterpret_cast<uint64_t>(buffer(first));
+    sqe->len = buffer_size_;
+    sqe->off = first;
+    sqe->buf_group = group_;
+    sqe->flags = IOSQE_CQE_SKIP_SUCCESS;
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <linux/io_uring.h>
+
+// Minimal io_uring wrapper on the raw syscalls: one submission and one
+// completion ring, mapped at construction. Only the reactor thread touches
+// it, so the ring indices need acquire/release ordering against the kernel
+// and nothing more.
+class IoUring {
+public:
+    explicit IoUring(unsigned entries);
+    ~IoUring();
+
+    IoUring(const IoUring&) = delete;
+    IoUring& operator=(const IoUring&) = delete;
+
+    int fd() const { return ring_fd_; }
+
+    // Returns a zeroed SQE. If the submission ring is full, the queued
+    // entries are submitted first to make room. Throws if the kernel keeps
+    // refusing them.
+    io_uring_sqe* get_sqe();
+
+    // Submits everything queued and waits for at least wait_nr
+    // completions, or none while stashed ones are pending. Returns a
+    // negative errno on failure.
+    int submit_and_wait(unsigned wait_nr);
+
+    // Calls f(const io_uring_cqe&) for each completion that is ready,
+    // stashed ones first.
+    template <typename F>
+    unsigned for_each_completion(F&& f) {
+        unsigned seen = 0;
+        while (true) {
+            io_uring_cqe cqe;
+            if (!stashed_.empty()) {
+                cqe = stashed_.front();
+                stashed_.pop_front();
+            } else {
+                // The handler may have moved the head by stashing.
+                unsigned head = *cq_head_;
+                if (head == __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE)) break;
+                cqe = cqes_[head & *cq_mask_];
+                // Release the slot before running the handler, which may
+                // queue more work.
+                __atomic_store_n(cq_head_, head + 1, __ATOMIC_RELEASE);
+            }
+            f(cqe);
+            ++seen;
+        }
+        return seen;
+    }
+
+private:
+    void unmap();
+    int enter(unsigned to_submit, unsigned wait_nr, unsigned flags);
+    unsigned stash_completions();
+
+    int ring_fd_ = -1;
+    unsigned features_ = 0;
+
+    void* sq_ring_ = nullptr;
+    size_t sq_ring_size_ = 0;
+    void* cq_ring_ = nullptr;
+    size_t cq_ring_size_ = 0;
+    io_uring_sqe* sqes_ = nullptr;
+    size_t sqes_size_ = 0;
+
+    unsigned* sq_head_ = nullptr;
+    unsigned* sq_tail_ = nullptr;
+    unsigned* sq_array_ = nullptr;
+    unsigned sq_mask_ = 0;
+    unsigned sq_entries_ = 0;
+    unsigned sqe_tail_ = 0;
+    unsigned submitted_ = 0;
+
+    unsigned* cq_head_ = nullptr;
+    unsigned* cq_tail_ = nullptr;
+    unsigned* cq_mask_ = nullptr;
+    io_uring_cqe* cqes_ = nullptr;
+    // Completions moved off the ring to let a refused submission through,
+    // in ring order.
+    std::deque<io_uring_cqe> stashed_;
+};
+
+// Receive buffers handed to the kernel with IORING_OP_PROVIDE_BUFFERS, so
+// a multishot recv picks a buffer only once data has actually arrived and
+// idle connections hold no receive memory.
+class BufferPool {
+public:
+    BufferPool(IoUring& ring, uint16_t group, unsigned count, unsigned buffer_size);
+    ~BufferPool();
+
+    BufferPool(const BufferPool&) = delete;
+    BufferPool& operator=(const BufferPool&) = delete;
+
+    uint16_t group() const { return group_; }
+    const char* buffer(uint16_t bid) const { return data_ + static_cast<size_t>(bid) * buffer_size_; }
+
+    // Gives a buffer the kernel filled back to the group. Nothing is
+    // reported on success, so this costs one SQE and no completion.
+    void recycle(uint16_t bid) { provide(bid, 1); }
+
+private:
+    void provide(uint16_t first, unsigned count);
+
+    IoUring& ring_;
+    char* data_ = nullptr;
+    size_t data_size_ = 0;
+    unsigned buffer_size_;
+    uint16_t group_;
+};
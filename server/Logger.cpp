@@ -0,0 +1,155 @@
+#include "Logger.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iterator>
+
+namespace {
+
+constexpr std::string_view kLevelNames[] = {"debug", "info", "warn", "error", "off"};
+
+size_t append_clipped(char* dst, size_t used, size_t cap, std::string_view src) {
+    size_t n = std::min(src.size(), cap - used);
+    std::memcpy(dst + used, src.data(), n);
+    return used + n;
+}
+
+}
+
+bool parse_log_level(std::string_view name, LogLevel& level) {
+    for (size_t i = 0; i < std::size(kLevelNames); ++i) {
+        if (name == kLevelNames[i]) {
+            level = static_cast<LogLevel>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+const char* log_level_name(LogLevel level) {
+    return kLevelNames[static_cast<size_t>(level)].data();
+}
+
+bool LogRing::push(std::time_t ts, LogLevel level, std::string_view peer,
+                   std::string_view prefix, std::string_view message) {
+    size_t head = head_.load(std::memory_order_relaxed);
+    if (head - tail_.load(std::memory_order_acquire) == kCapacity) {
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    Record& r = slots_[head % kCapacity];
+    r.ts = ts;
+    r.level = level;
+
+    size_t len = 0;
+    if (!peer.empty()) {
+        len = append_clipped(r.text, len, kTextSize, "From ");
+        len = append_clipped(r.text, len, kTextSize, peer);
+        len = append_clipped(r.text, len, kTextSize, " — ");
+    }
+    len = append_clipped(r.text, len, kTextSize, prefix);
+    len = append_clipped(r.text, len, kTextSize, ": ");
+    len = append_clipped(r.text, len, kTextSize, message);
+    r.len = static_cast<uint16_t>(len);
+
+    head_.store(head + 1, std::memory_order_release);
+    return true;
+}
+
+bool LogRing::pop(Record& out) {
+    size_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail == head_.load(std::memory_order_acquire)) return false;
+
+    const Record& r = slots_[tail % kCapacity];
+    out.ts = r.ts;
+    out.level = r.level;
+    out.len = r.len;
+    std::memcpy(out.text, r.text, r.len);
+
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+}
+
+Logger& Logger::instance() {
+    static Logger logger;
+    return logger;
+}
+
+Logger::Logger() : now_(std::time(nullptr)) {
+    writer_ = std::thread([this] { writer_loop(); });
+}
+
+Logger::~Logger() {
+    {
+        std::lock_guard<std::mutex> lock(stop_mutex_);
+        stop_ = true;
+    }
+    stop_cv_.notify_one();
+    writer_.join();
+}
+
+LogRing* Logger::create_ring() {
+    std::lock_guard<std::mutex> lock(rings_mutex_);
+    rings_.push_back(std::make_unique<LogRing>());
+    return rings_.back().get();
+}
+
+const std::string& Logger::timestamp(std::time_t ts) {
+    if (ts != cached_ts_) {
+        std::tm tm{};
+        localtime_r(&ts, &tm);
+        char buf[32];
+        size_t n = std::strftime(buf, sizeof(buf), "[%Y-%m-%d %H:%M:%S]", &tm);
+        cached_ts_str_.assign(buf, n);
+        cached_ts_ = ts;
+    }
+    return cached_ts_str_;
+}
+
+size_t Logger::drain(std::string& out) {
+    std::lock_guard<std::mutex> lock(rings_mutex_);
+
+    size_t written = 0;
+    uint64_t drops = 0;
+    LogRing::Record rec;
+    for (auto& ring : rings_) {
+        while (ring->pop(rec)) {
+            out += timestamp(rec.ts);
+            out += ' ';
+            out.append(rec.text, rec.len);
+            out += '\n';
+            ++written;
+        }
+        drops += ring->dropped();
+    }
+
+    if (drops != reported_drops_) {
+        out += timestamp(now());
+        out += " Logger: dropped " + std::to_string(drops - reported_drops_) + " records\n";
+        reported_drops_ = drops;
+    }
+    return written;
+}
+
+void Logger::writer_loop() {
+    std::string out;
+    std::unique_lock<std::mutex> lock(stop_mutex_);
+    while (true) {
+        bool stopping = stop_cv_.wait_for(lock, std::chrono::milliseconds(5), [this] { return stop_; });
+        now_.store(std::time(nullptr), std::memory_order_relaxed);
+
+        lock.unlock();
+        out.clear();
+        drain(out);
+        if (!out.empty()) {
+            std::fwrite(out.data(), 1, out.size(), stdout);
+            std::fflush(stdout);
+        }
+        lock.lock();
+
+        if (stopping) break;
+    }
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+enum class LogLevel : uint8_t { Debug, Info, Warn, Error, Off };
+
+bool parse_log_level(std::string_view name, LogLevel& level);
+const char* log_level_name(LogLevel level);
+
+// Single-producer/single-consumer ring of fixed-size records. The owning
+// reactor is the only producer, the logger's writer thread the only consumer.
+// A full ring drops the record instead of blocking the event loop.
+class LogRing {
+public:
+    static constexpr size_t kCapacity = 4096;
+    static constexpr size_t kTextSize = 240;
+
+    struct Record {
+        std::time_t ts;
+        LogLevel level;
+        uint16_t len;
+        char text[kTextSize];
+    };
+
+    bool push(std::time_t ts, LogLevel level, std::string_view peer,
+              std::string_view prefix, std::string_view message);
+    bool pop(Record& out);
+
+    uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+private:
+    std::array<Record, kCapacity> slots_;
+    alignas(64) std::atomic<size_t> head_{0};
+    alignas(64) std::atomic<size_t> tail_{0};
+    std::atomic<uint64_t> dropped_{0};
+};
+
+class Logger {
+public:
+    static Logger& instance();
+
+    ~Logger();
+
+    void set_level(LogLevel level) { level_.store(level, std::memory_order_relaxed); }
+    bool enabled(LogLevel level) const {
+        return level >= level_.load(std::memory_order_relaxed);
+    }
+
+    // Wall-clock seconds refreshed by the writer thread, so producers never
+    // have to ask the kernel for the time.
+    std::time_t now() const { return now_.load(std::memory_order_relaxed); }
+
+    LogRing* create_ring();
+
+    void log(LogRing& ring, LogLevel level, std::string_view peer,
+             std::string_view prefix, std::string_view message) {
+        if (enabled(level)) ring.push(now(), level, peer, prefix, message);
+    }
+
+private:
+    Logger();
+
+    void writer_loop();
+    size_t drain(std::string& out);
+    const std::string& timestamp(std::time_t ts);
+
+    std::atomic<LogLevel> level_{LogLevel::Info};
+    std::atomic<std::time_t> now_;
+
+    std::mutex rings_mutex_;
+    std::vector<std::unique_ptr<LogRing>> rings_;
+    uint64_t reported_drops_ = 0;
+
+    std::time_t cached_ts_ = -1;
+    std::string cached_ts_str_;
+
+    std::mutex stop_mutex_;
+    std::condition_variable stop_cv_;
+    bool stop_ = false;
+    std::thread writer_;
+};
@@ -0,0 +1,208 @@
+#include "Metrics.h"
+
+#include <cstdio>
+
+namespace {
+
+constexpr const char* kErrorNames[] = {
+    "none",
+    "empty_expression",
+    "invalid_character",
+    "unexpected_characters",
+    "expected_number",
+    "expected_digit",
+    "invalid_number",
+    "division_by_zero",
+    "modulo_by_zero",
+    "overflow",
+    "expression_too_long",
+};
+static_assert(sizeof(kErrorNames) / sizeof(kErrorNames[0]) == kCalcErrorCount, "one name per CalcError");
+
+// Exported histogram bounds: every power of two from 256 ns to about 34 s.
+constexpr unsigned kFirstBound = 8;
+constexpr unsigned kLastBound = 35;
+
+struct MergedHistogram {
+    uint64_t buckets[Histogram::kBuckets] = {};
+    uint64_t sum = 0;
+
+    void add(const Histogram& h) {
+        for (size_t i = 0; i < Histogram::kBuckets; ++i) buckets[i] += h.bucket(i);
+        sum += h.sum();
+    }
+};
+
+void append_header(std::string& out, const char* name, const char* type, const char* help) {
+    out += "# HELP ";
+    out += name;
+    out += ' ';
+    out += help;
+    out += "\n# TYPE ";
+    out += name;
+    out += ' ';
+    out += type;
+    out += '\n';
+}
+
+void append_value(std::string& out, const char* name, const char* type, const char* help, uint64_t value) {
+    append_header(out, name, type, help);
+    out += name;
+    out += ' ';
+    out += std::to_string(value);
+    out += '\n';
+}
+
+// A gauge split into in-use and cached parts.
+void append_pool_gauge(std::string& out, const char* name, const char* help, uint64_t in_use, uint64_t cached) {
+    append_header(out, name, "gauge", help);
+    out += name;
+    out += "{state=\"in_use\"} ";
+    out += std::to_string(in_use);
+    out += '\n';
+    out += name;
+    out += "{state=\"cached\"} ";
+    out += std::to_string(cached);
+    out += '\n';
+}
+
+void append_seconds(std::string& out, double seconds) {
+    char buf[32];
+    int n = std::snprintf(buf, sizeof(buf), "%.9g", seconds);
+    out.append(buf, n);
+}
+
+// Bucket i only holds values below 2^b once i < bucket_of(2^b), so the
+// cumulative count at each power of two is exact.
+void append_histogram(std::string& out, const char* name, const char* help, const MergedHistogram& h) {
+    append_header(out, name, "histogram", help);
+
+    uint64_t cumulative = 0;
+    size_t next = 0;
+    for (unsigned bits = kFirstBound; bits <= kLastBound; ++bits) {
+        size_t end = Histogram::bucket_of(uint64_t{1} << bits);
+        for (; next < end; ++next) cumulative += h.buckets[next];
+        out += name;
+        out += "_bucket{le=\"";
+        append_seconds(out, static_cast<double>(uint64_t{1} << bits) / 1e9);
+        out += "\"} ";
+        out += std::to_string(cumulative);
+        out += '\n';
+    }
+    for (; next < Histogram::kBuckets; ++next) cumulative += h.buckets[next];
+
+    out += name;
+    out += "_bucket{le=\"+Inf\"} ";
+    out += std::to_string(cumulative);
+    out += '\n';
+    out += name;
+    out += "_sum ";
+    append_seconds(out, static_cast<double>(h.sum) / 1e9);
+    out += '\n';
+    out += name;
+    out += "_count ";
+    out += std::to_string(cumulative);
+    out += '\n';
+}
+
+}
+
+MetricsRegistry& MetricsRegistry::instance() {
+    static MetricsRegistry registry;
+    return registry;
+}
+
+ReactorMetrics* MetricsRegistry::create_reactor() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    reactors_.push_back(std::make_unique<ReactorMetrics>());
+    return reactors_.back().get();
+}
+
+std::string MetricsRegistry::render() {
+    uint64_t accepted = 0, closed = 0, received = 0, sent = 0, expressions = 0, offloaded = 0;
+    uint64_t deferred = 0;
+    uint64_t errors[kCalcErrorCount] = {};
+    uint64_t hits = 0, misses = 0, evictions = 0, entries = 0, cache_bytes = 0, buffered = 0;
+    uint64_t reaped[3] = {};
+    uint64_t blocks_in_use = 0, bytes_in_use = 0, blocks_cached = 0, bytes_cached = 0;
+    auto latency = std::make_unique<MergedHistogram>();
+    auto iteration = std::make_unique<MergedHistogram>();
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (const auto& m : reactors_) {
+            // closed before accepted, so the difference is never negative.
+            closed += m->closed.load();
+            accepted += m->accepted.load();
+            received += m->received_bytes.load();
+            sent += m->sent_bytes.load();
+            expressions += m->expressions.load();
+            offloaded += m->offloaded.load();
+            deferred += m->deferred_turns.load();
+            for (size_t i = 0; i < kCalcErrorCount; ++i) errors[i] += m->errors[i].load();
+            hits += m->cache_hits.load();
+            misses += m->cache_misses.load();
+            evictions += m->cache_evictions.load();
+            entries += m->cache_entries.load();
+            cache_bytes += m->cache_bytes.load();
+            buffered += m->buffered_bytes.load();
+            blocks_in_use += m->pool_blocks_in_use.load();
+            bytes_in_use += m->pool_bytes_in_use.load();
+            blocks_cached += m->pool_blocks_cached.load();
+            bytes_cached += m->pool_bytes_cached.load();
+            reaped[0] += m->reaped_idle.load();
+            reaped[1] += m->reaped_header.load();
+            reaped[2] += m->reaped_write.load();
+            latency->add(m->request_latency);
+            iteration->add(m->loop_iteration);
+        }
+    }
+    if (closed > accepted) closed = accepted;
+
+    std::string out;
+    append_value(out, "calc_accepted_connections_total", "counter", "Connections accepted.", accepted);
+    append_value(out, "calc_active_connections", "gauge", "Connections currently open.", accepted - closed);
+    append_value(out, "calc_received_bytes_total", "counter", "Bytes read from clients.", received);
+    append_value(out, "calc_sent_bytes_total", "counter", "Bytes written to clients.", sent);
+    append_value(out, "calc_expressions_total", "counter", "Expressions answered.", expressions);
+    append_value(out, "calc_offloaded_expressions_total", "counter", "Expressions evaluated on the worker pool.",
+                 offloaded);
+    append_value(out, "calc_deferred_turns_total", "counter",
+                 "Connection turns cut short by the read or expression budget.", deferred);
+
+    append_header(out, "calc_errors_total", "counter", "Expressions answered with an error, by error.");
+    for (size_t i = 1; i < kCalcErrorCount; ++i) {
+        out += "calc_errors_total{error=\"";
+        out += kErrorNames[i];
+        out += "\"} ";
+        out += std::to_string(errors[i]);
+        out += '\n';
+    }
+
+    append_header(out, "calc_reaped_connections_total", "counter", "Connections closed by a timeout, by reason.");
+    const char* reasons[] = {"idle", "header", "write"};
+    for (size_t i = 0; i < 3; ++i) {
+        out += "calc_reaped_connections_total{reason=\"";
+        out += reasons[i];
+        out += "\"} ";
+        out += std::to_string(reaped[i]);
+        out += '\n';
+    }
+
+    append_value(out, "calc_cache_hits_total", "counter", "Result cache hits.", hits);
+    append_value(out, "calc_cache_misses_total", "counter", "Result cache misses.", misses);
+    append_value(out, "calc_cache_evictions_total", "counter", "Result cache evictions.", evictions);
+    append_value(out, "calc_cache_entries", "gauge", "Entries in the result caches.", entries);
+    append_value(out, "calc_cache_bytes", "gauge", "Bytes used by the result caches.", cache_bytes);
+    append_value(out, "calc_buffered_bytes", "gauge", "Bytes held in connection buffers.", buffered);
+    append_pool_gauge(out, "calc_buffer_pool_blocks", "Buffer pool blocks lent to connections or kept free.",
+                      blocks_in_use, blocks_cached);
+    append_pool_gauge(out, "calc_buffer_pool_bytes", "Buffer pool bytes lent to connections or kept free.",
+                      bytes_in_use, bytes_cached);
+
+    append_histogram(out, "calc_request_latency_seconds",
+                     "Time from receiving a request to writing its response.", *latency);
+    append_histogram(out, "calc_loop_iteration_seconds", "Time spent handling one batch of ready events.",
+                     *iteration);
+    return out;
+}
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "CalcResult.h"
+
+inline uint64_t monotonic_ns() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000u + static_cast<uint64_t>(ts.tv_nsec);
+}
+
+// A value with a single writer, its reactor, read by the admin thread.
+// Updates are a relaxed load and store rather than a locked read-modify-
+// write, so recording costs the same as bumping a plain integer.
+class Counter {
+public:
+    void add(uint64_t n = 1) { value_.store(value_.load(std::memory_order_relaxed) + n, std::memory_order_relaxed); }
+    void set(uint64_t v) { value_.store(v, std::memory_order_relaxed); }
+    uint64_t load() const { return value_.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<uint64_t> value_{0};
+};
+
+// Log-linear histogram of nanosecond durations in the style of HDR
+// histograms: each power of two is split into 2^kSubBits equal buckets, so
+// a recorded value is off by at most 1/16 of itself. Values of 2^kMaxBits
+// ns (about 18 minutes) and above land in the last bucket.
+class Histogram {
+public:
+    static constexpr unsigned kSubBits = 4;
+    static constexpr unsigned kMaxBits = 40;
+    static constexpr size_t kBuckets = (kMaxBits - kSubBits + 1) << kSubBits;
+
+    static size_t bucket_of(uint64_t ns) {
+        if (ns < (uint64_t{1} << kSubBits)) return ns;
+        if (ns >= (uint64_t{1} << kMaxBits)) return kBuckets - 1;
+        unsigned exponent = 63 - __builtin_clzll(ns);
+        size_t sub = (ns >> (exponent - kSubBits)) & ((1u << kSubBits) - 1);
+        return ((exponent - kSubBits + 1) << kSubBits) + sub;
+    }
+
+    void record(uint64_t ns, uint64_t count = 1) {
+        buckets_[bucket_of(ns)].add(count);
+        sum_.add(ns * count);
+    }
+
+    uint64_t bucket(size_t i) const { return buckets_[i].load(); }
+    uint64_t sum() const { return sum_.load(); }
+
+private:
+    Counter buckets_[kBuckets];
+    Counter sum_;
+};
+
+// Everything one reactor records. Only that reactor writes; the admin
+// thread merges all of them when it is scraped.
+struct alignas(64) ReactorMetrics {
+    Counter accepted;
+    Counter closed;
+    Counter received_bytes;
+    Counter sent_bytes;
+    Counter expressions;
+    Counter offloaded;
+    // Turns that ended on the read or expression budget with work left.
+    Counter deferred_turns;
+    Counter errors[kCalcErrorCount];
+
+    // Copied from the reactor's cache, flow accounting and buffer pool once
+    // per loop iteration.
+    Counter cache_hits;
+    Counter cache_misses;
+    Counter cache_evictions;
+    Counter cache_entries;
+    Counter cache_bytes;
+    Counter buffered_bytes;
+    Counter pool_blocks_in_use;
+    Counter pool_bytes_in_use;
+    Counter pool_blocks_cached;
+    Counter pool_bytes_cached;
+
+    // Connections closed by a timeout, by reason.
+    Counter reaped_idle;
+    Counter reaped_header;
+    Counter reaped_write;
+
+    // From the read that delivered a request to the write that carries
+    // its response, and the time spent on one batch of ready events.
+    Histogram request_latency;
+    Histogram loop_iteration;
+};
+
+class MetricsRegistry {
+public:
+    static MetricsRegistry& instance();
+
+    ReactorMetrics* create_reactor();
+
+    // All reactors merged, in the Prometheus text exposition format.
+    std::string render();
+
+private:
+    MetricsRegistry() = default;
+
+    std::mutex mutex_;
+    std::vector<std::unique_ptr<ReactorMetrics>> reactors_;
+};
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <atomic>
+
+struct MpscNode {
+    std::atomic<MpscNode*> next{nullptr};
+};
+
+// Intrusive lock-free multi-producer/single-consumer queue (Vyukov). push()
+// is wait-free; pop() may return nullptr while a concurrent push is half
+// done, so producers must signal the consumer after pushing (the callers
+// use an eventfd) and the consumer simply tries again on the next signal.
+template <typename T>
+class MpscQueue {
+public:
+    MpscQueue() : head_(&stub_), tail_(&stub_) {}
+
+    MpscQueue(const MpscQueue&) = delete;
+    MpscQueue& operator=(const MpscQueue&) = delete;
+
+    void push(T* item) { push_node(item); }
+
+    T* pop() {
+        MpscNode* tail = tail_;
+        MpscNode* next = tail->next.load(std::memory_order_acquire);
+        if (tail == &stub_) {
+            if (!next) return nullptr;
+            tail_ = next;
+            tail = next;
+            next = next->next.load(std::memory_order_acquire);
+        }
+        if (next) {
+            tail_ = next;
+            return static_cast<T*>(tail);
+        }
+        if (tail != head_.load(std::memory_order_acquire)) return nullptr;
+
+        push_node(&stub_);
+        next = tail->next.load(std::memory_order_acquire);
+        if (next) {
+            tail_ = next;
+            return static_cast<T*>(tail);
+        }
+        return nullptr;
+    }
+
+private:
+    void push_node(MpscNode* node) {
+        node->next.store(nullptr, std::memory_order_relaxed);
+        MpscNode* prev = head_.exchange(node, std::memory_order_acq_rel);
+        prev->next.store(node, std::memory_order_release);
+    }
+
+    alignas(64) std::atomic<MpscNode*> head_;
+    alignas(64) MpscNode* tail_;
+    MpscNode stub_;
+};
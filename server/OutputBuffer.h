@@ -0,0 +1,128 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <sys/uio.h>
+
+#include "BlockPool.h"
+
+// Per-connection send queue made of fixed-size blocks, so queued responses
+// never move and a whole batch can be handed to the kernel with a single
+// sendmsg() over an iovec array. Blocks come from the reactor's BlockPool
+// and go back as soon as they are drained.
+class OutputBuffer {
+public:
+    // Pool block size, including the block header.
+    static constexpr size_t kBlockSize = 16384;
+
+    OutputBuffer() = default;
+    OutputBuffer(const OutputBuffer&) = delete;
+    OutputBuffer& operator=(const OutputBuffer&) = delete;
+    OutputBuffer(OutputBuffer&& other) noexcept { swap(other); }
+    OutputBuffer& operator=(OutputBuffer&& other) noexcept {
+        OutputBuffer tmp(std::move(other));
+        swap(tmp);
+        return *this;
+    }
+    ~OutputBuffer() {
+        while (head_) release_head();
+    }
+
+    // Takes blocks from pool from now on; call while nothing is queued.
+    void attach(BlockPool* pool) { pool_ = pool; }
+
+    void append(std::string_view data) {
+        while (!data.empty()) {
+            Block* b = writable_block();
+            size_t n = std::min(data.size(), Block::kCapacity - b->end);
+            std::memcpy(b->data() + b->end, data.data(), n);
+            b->end += n;
+            size_ += n;
+            data.remove_prefix(n);
+        }
+    }
+
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+
+    // Fills iov with the queued data and returns the number of entries used.
+    int fill_iovec(iovec* iov, int max) const {
+        int n = 0;
+        for (Block* b = head_; b && n < max; b = b->next) {
+            if (b->begin == b->end) continue;
+            iov[n].iov_base = b->data() + b->begin;
+            iov[n].iov_len = b->end - b->begin;
+            ++n;
+        }
+        return n;
+    }
+
+    // Copy of the first n queued bytes, for debug logging.
+    std::string peek(size_t n) const {
+        std::string out;
+        for (Block* b = head_; b && out.size() < n; b = b->next) {
+            out.append(b->data() + b->begin, std::min(b->end - b->begin, n - out.size()));
+        }
+        return out;
+    }
+
+    // Drops n bytes from the front after they have been sent.
+    void consume(size_t n) {
+        size_ -= n;
+        while (n > 0) {
+            size_t avail = head_->end - head_->begin;
+            size_t k = std::min(n, avail);
+            head_->begin += k;
+            n -= k;
+            if (head_->begin == head_->end) release_head();
+        }
+        if (size_ == 0) {
+            while (head_) release_head();
+        }
+    }
+
+    void clear() { consume(size_); }
+
+private:
+    // Header at the start of a pool block; the data follows it.
+    struct Block {
+        static constexpr size_t kCapacity = kBlockSize - 3 * sizeof(size_t);
+
+        Block* next = nullptr;
+        size_t begin = 0;
+        size_t end = 0;
+
+        char* data() { return reinterpret_cast<char*>(this + 1); }
+    };
+    static_assert(sizeof(Block) == kBlockSize - Block::kCapacity, "data follows the header");
+
+    Block* writable_block() {
+        if (tail_ && tail_->end < Block::kCapacity) return tail_;
+        Block* b = new (acquire_block(pool_, kBlockSize)) Block;
+        if (tail_) tail_->next = b; else head_ = b;
+        tail_ = b;
+        return b;
+    }
+
+    void release_head() {
+        Block* b = head_;
+        head_ = b->next;
+        if (!head_) tail_ = nullptr;
+        release_block(pool_, reinterpret_cast<char*>(b), kBlockSize);
+    }
+
+    void swap(OutputBuffer& other) noexcept {
+        std::swap(pool_, other.pool_);
+        std::swap(head_, other.head_);
+        std::swap(tail_, other.tail_);
+        std::swap(size_, other.size_);
+    }
+
+    BlockPool* pool_ = nullptr;
+    Block* head_ = nullptr;
+    Block* tail_ = nullptr;
+    size_t size_ = 0;
+};
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+// Binary wire protocol, spoken on a connection whose first bytes are
+// kBinaryPreface; any other first byte selects the space-delimited text
+// protocol. Integers are little-endian.
+//
+//   request:  u32 length | u32 request_id | u8 flags | expression bytes
+//   response: u32 length | u32 request_id | u8 status | u8 flags |
+//             u16 reserved | f64 value | text
+//
+// length counts the bytes after the length field itself. status is the
+// CalcError code (0 on success) and value is the raw IEEE-754 result. If
+// the request set kWantText, the response carries the text-protocol line
+// without its newline and echoes the flag. Responses may arrive in any
+// order; request_id ties them to their requests.
+namespace protocol {
+
+constexpr char kBinaryPreface[4] = {'\0', 'C', 'B', '1'};
+
+constexpr size_t kLengthSize = 4;
+constexpr size_t kRequestHeader = kLengthSize + 4 + 1;
+constexpr size_t kResponseHeader = kLengthSize + 4 + 1 + 1 + 2 + 8;
+
+constexpr uint8_t kWantText = 0x01;
+
+inline void put_u32(char* p, uint32_t v) {
+    for (int i = 0; i < 4; ++i) p[i] = static_cast<char>(v >> (8 * i));
+}
+
+inline uint32_t get_u32(const char* p) {
+    uint32_t v = 0;
+    for (int i = 0; i < 4; ++i) v |= static_cast<uint32_t>(static_cast<unsigned char>(p[i])) << (8 * i);
+    return v;
+}
+
+inline void put_f64(char* p, double value) {
+    uint64_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    for (int i = 0; i < 8; ++i) p[i] = static_cast<char>(bits >> (8 * i));
+}
+
+inline double get_f64(const char* p) {
+    uint64_t bits = 0;
+    for (int i = 0; i < 8; ++i) bits |= static_cast<uint64_t>(static_cast<unsigned char>(p[i])) << (8 * i);
+    double value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+inline void append_request(std::string& out, uint32_t request_id, uint8_t flags, std::string_view expr) {
+    char header[kRequestHeader];
+    put_u32(header, static_cast<uint32_t>(kRequestHeader - kLengthSize + expr.size()));
+    put_u32(header + 4, request_id);
+    header[8] = static_cast<char>(flags);
+    out.append(header, sizeof(header));
+    out.append(expr);
+}
+
+struct Response {
+    uint32_t request_id = 0;
+    uint8_t status = 0;
+    uint8_t flags = 0;
+    double value = 0.0;
+    std::string_view text;
+};
+
+// Parses the response frame at the front of data. Returns the frame size,
+// or 0 if data does not hold a complete frame yet.
+inline size_t parse_response(std::string_view data, Response& out) {
+    if (data.size() < kLengthSize) return 0;
+    size_t size = kLengthSize + get_u32(data.data());
+    if (size < kResponseHeader || data.size() < size) return 0;
+
+    const char* p = data.data();
+    out.request_id = get_u32(p + 4);
+    out.status = static_cast<uint8_t>(p[8]);
+    out.flags = static_cast<uint8_t>(p[9]);
+    out.value = get_f64(p + 12);
+    out.text = std::string_view(p + kResponseHeader, size - kResponseHeader);
+    return size;
+}
+
+}
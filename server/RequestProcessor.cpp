@@ -0,0 +1,638 @@
+#include "RequestProcessor.h"
+#include "Format.h"
+#include "Socket.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+
+// ResultCache variants: text lines, and binary response bodies (the frame
+// after length and request id) with and without the text rendering.
+constexpr uint8_t CACHE_TEXT = 0;
+constexpr uint8_t CACHE_BINARY = 1;
+constexpr uint8_t CACHE_BINARY_TEXT = 2;
+constexpr size_t BINARY_BODY_OFFSET = protocol::kLengthSize + 4;
+// Most complete requests answered with one call into the calculator.
+constexpr size_t EVAL_BATCH = 32;
+// Timeouts are checked at this granularity.
+constexpr uint64_t TIMER_TICK_NS = 100 * 1000 * 1000;
+
+std::atomic<size_t> RequestProcessor::total_buffered_{0};
+
+RequestProcessor::RequestProcessor(const ServerOptions& options)
+    : calc_(options.exact),
+      cache_(options.cache_bytes),
+      workers_(options.workers),
+      offload_bytes_(options.offload_bytes),
+      high_watermark_(options.output_high_watermark),
+      low_watermark_(options.output_low_watermark),
+      max_expression_(options.max_expression_bytes),
+      streaming_(options.streaming),
+      expression_budget_(options.expression_budget ? options.expression_budget : SIZE_MAX),
+      timers_(TIMER_TICK_NS),
+      idle_timeout_ns_(options.idle_timeout_ms * 1000000),
+      header_timeout_ns_(options.header_timeout_ms * 1000000),
+      write_timeout_ns_(options.write_timeout_ms * 1000000),
+      log_ring_(Logger::instance().create_ring()),
+      metrics_(MetricsRegistry::instance().create_reactor()) {
+    if (workers_) completions_ = std::make_unique<CompletionQueue>();
+}
+
+void RequestProcessor::on_connected(Connection& conn, uint64_t id, const sockaddr_in& addr) {
+    conn.id = id;
+    format_peer(addr, conn.peer, sizeof(conn.peer));
+    conn.in_buf.attach(&blocks_);
+    conn.out_buf.attach(&blocks_);
+    conn.timer.owner = &conn;
+    metrics_->accepted.add();
+    log(conn, LogLevel::Info, "Connected", "New client connected");
+    // The idle timeout runs from accept, so a client that never sends a
+    // byte is reaped like one that went quiet after a request.
+    arm_timeout(conn);
+}
+
+bool RequestProcessor::negotiate(Connection& conn) {
+    std::string_view head = conn.in_buf.pending();
+    size_t n = std::min(head.size(), sizeof(protocol::kBinaryPreface));
+    if (n == 0) return false;
+
+    if (head.compare(0, n, protocol::kBinaryPreface, n) != 0) {
+        conn.protocol = WireProtocol::Text;
+        return true;
+    }
+    if (n < sizeof(protocol::kBinaryPreface)) return false;
+
+    conn.in_buf.take(n);
+    conn.protocol = WireProtocol::Binary;
+    log(conn, LogLevel::Info, "Protocol", "Binary");
+    return true;
+}
+
+void RequestProcessor::on_input(Connection& conn) {
+    if (conn.closing) {
+        conn.in_buf.clear();
+        return;
+    }
+    conn.input_deferred = false;
+    if (conn.protocol == WireProtocol::Unknown && !negotiate(conn)) return;
+    if (conn.protocol == WireProtocol::Binary) {
+        process_frames(conn);
+    } else {
+        process_lines(conn);
+    }
+    if (conn.peer_closed && !conn.input_deferred) on_peer_closed(conn);
+}
+
+void RequestProcessor::defer(Connection& conn) {
+    if (conn.ready_queued) return;
+    conn.ready_queued = true;
+    ready_.push_back(conn.id);
+    metrics_->deferred_turns.add();
+}
+
+void RequestProcessor::process_lines(Connection& conn) {
+    std::string_view expr;
+    if (conn.discard_to_delimiter) {
+        if (!conn.in_buf.next_frame(' ', expr)) {
+            conn.in_buf.clear();
+            return;
+        }
+        conn.discard_to_delimiter = false;
+        conn.request_started_ns = now_ns_;
+    }
+
+    bool waiting = conn.streaming() && !stream_input(conn);
+    if (!waiting) {
+        // Views into in_buf, which stay valid while nothing is read.
+        std::string_view batch[EVAL_BATCH];
+        size_t count = 0;
+        while (true) {
+            if (conn.turn_budget == 0) {
+                conn.input_deferred = true;
+                break;
+            }
+            if (!conn.in_buf.next_frame(' ', expr)) break;
+            --conn.turn_budget;
+            conn.request_started_ns = now_ns_;
+            batch[count++] = expr;
+            if (count == EVAL_BATCH) {
+                answer_expressions(conn, batch, count, false);
+                count = 0;
+            }
+        }
+        answer_expressions(conn, batch, count, false);
+        // The unterminated tail is evaluated as it arrives rather than
+        // held until its delimiter.
+        if (streaming_ && !conn.input_deferred && !conn.in_buf.empty()) stream_input(conn);
+    }
+
+    // No delimiter within the limit: answer now and skip the rest of the
+    // expression as it arrives instead of buffering it. Deferred input is
+    // complete requests, not one long one.
+    size_t unterminated = conn.streaming() ? conn.stream->length() : conn.in_buf.size();
+    if (!conn.input_deferred && unterminated > max_expression_) {
+        reject_oversized(conn, 0, 0);
+        conn.stream.reset();
+        conn.in_buf.clear();
+        conn.discard_to_delimiter = true;
+    }
+}
+
+bool RequestProcessor::stream_input(Connection& conn) {
+    if (!conn.stream) {
+        conn.stream = std::make_unique<StreamingCalc>();
+        conn.stream->set_exact(calc_.exact());
+    }
+    bool complete;
+    conn.in_buf.take(conn.stream->feed(conn.in_buf.pending(), ' ', complete));
+    if (!complete) return false;
+
+    conn.request_started_ns = now_ns_;
+    if (conn.stream->length() > max_expression_) {
+        reject_oversized(conn, 0, 0);
+    } else if (conn.stream->length() > 0) {
+        respond_streamed(conn, false);
+    }
+    conn.stream.reset();
+    return true;
+}
+
+void RequestProcessor::respond_streamed(Connection& conn, bool last) {
+    const CalcResult& result = conn.stream->result();
+    char line[kMaxResponseLine];
+    std::string_view response(line, format_response(result, line));
+    queue_response(conn, response);
+    count_result(result.error);
+
+    if (log_enabled(LogLevel::Debug)) {
+        log(conn, LogLevel::Debug, last ? "Streamed (last)" : "Streamed",
+            std::to_string(conn.stream->length()) + " bytes = " + std::string(response));
+    }
+}
+
+void RequestProcessor::process_frames(Connection& conn) {
+    FrameRequest batch[EVAL_BATCH];
+    size_t count = 0;
+    while (cut_frame(conn, batch[count])) {
+        if (++count == EVAL_BATCH) {
+            answer_frames(conn, batch, count);
+            count = 0;
+        }
+    }
+    answer_frames(conn, batch, count);
+}
+
+bool RequestProcessor::cut_frame(Connection& conn, FrameRequest& request) {
+    // Frames are cut by their length prefix; the payload is never scanned.
+    while (true) {
+        if (conn.discard_bytes > 0) {
+            size_t n = std::min(conn.discard_bytes, conn.in_buf.size());
+            conn.in_buf.take(n);
+            conn.discard_bytes -= n;
+            if (conn.discard_bytes > 0) return false;
+        }
+        if (conn.in_buf.size() < protocol::kLengthSize) return false;
+
+        const char* p = conn.in_buf.pending().data();
+        size_t size = protocol::kLengthSize + protocol::get_u32(p);
+        if (size < protocol::kRequestHeader) {
+            log(conn, LogLevel::Warn, "Protocol error", "Frame shorter than its header");
+            conn.in_buf.clear();
+            conn.closing = true;
+            return false;
+        }
+
+        // The header alone is enough to turn down an oversized frame.
+        if (size - protocol::kRequestHeader > max_expression_) {
+            if (conn.in_buf.size() < protocol::kRequestHeader) return false;
+            reject_oversized(conn, protocol::get_u32(p + 4), static_cast<uint8_t>(p[8]));
+            conn.discard_bytes = size;
+            conn.request_started_ns = now_ns_;
+            continue;
+        }
+        if (conn.in_buf.size() < size) return false;
+        if (conn.turn_budget == 0) {
+            conn.input_deferred = true;
+            return false;
+        }
+        --conn.turn_budget;
+
+        std::string_view frame = conn.in_buf.take(size);
+        conn.request_started_ns = now_ns_;
+        request.id = protocol::get_u32(frame.data() + 4);
+        request.flags = static_cast<uint8_t>(frame[8]);
+        request.expr = frame.substr(protocol::kRequestHeader);
+        return true;
+    }
+}
+
+void RequestProcessor::answer_frames(Connection& conn, const FrameRequest* requests, size_t count) {
+    // Same scheme as answer_expressions(); responses carry their request
+    // ids, so only the cached views need the inserts held back.
+    Disposition disposition[EVAL_BATCH];
+    std::string_view cached[EVAL_BATCH];
+    std::string_view misses[EVAL_BATCH];
+    CalcResult results[EVAL_BATCH];
+    size_t evaluated = 0;
+    for (size_t i = 0; i < count; ++i) {
+        const FrameRequest& r = requests[i];
+        uint8_t variant = (r.flags & protocol::kWantText) ? CACHE_BINARY_TEXT : CACHE_BINARY;
+        cached[i] = cache_.find(r.expr, variant);
+        if (!cached[i].empty()) {
+            disposition[i] = Disposition::Cached;
+        } else if (workers_ && r.expr.size() >= offload_bytes_) {
+            disposition[i] = Disposition::Offloaded;
+        } else {
+            disposition[i] = Disposition::Evaluated;
+            misses[evaluated++] = r.expr;
+        }
+    }
+    if (evaluated > 0) calc_.try_calculate_batch(misses, evaluated, results);
+
+    char frame[kMaxBinaryResponse];
+    size_t result_ends[EVAL_BATCH];
+    size_t next = 0;
+    batch_text_.clear();
+    for (size_t i = 0; i < count; ++i) {
+        const FrameRequest& r = requests[i];
+        if (disposition[i] == Disposition::Cached) {
+            protocol::put_u32(frame, static_cast<uint32_t>(4 + cached[i].size()));
+            protocol::put_u32(frame + 4, r.id);
+            conn.out_buf.append(std::string_view(frame, BINARY_BODY_OFFSET));
+            conn.out_buf.append(cached[i]);
+            ++conn.unrecorded_responses;
+            // The body starts with the status byte, which is the CalcError.
+            count_result(static_cast<CalcError>(cached[i][0]));
+            continue;
+        }
+        if (disposition[i] == Disposition::Offloaded) {
+            OffloadJob* job = make_job(conn, r.expr);
+            job->binary = true;
+            job->request_id = r.id;
+            job->flags = r.flags;
+            ++conn.binary_jobs;
+            metrics_->offloaded.add();
+            workers_->submit(job);
+            continue;
+        }
+
+        const CalcResult& result = results[next];
+        size_t len = format_binary_response(r.id, result, r.flags, frame);
+        conn.out_buf.append(std::string_view(frame, len));
+        ++conn.unrecorded_responses;
+        count_result(result.error);
+
+        if (log_enabled(LogLevel::Debug)) {
+            char line[kMaxResponseLine];
+            size_t n = format_response(result, line);
+            log(conn, LogLevel::Debug, "Calculated (binary)",
+                "#" + std::to_string(r.id) + " " + std::string(r.expr) + " = " + std::string(line, n));
+        }
+        if (cache_.enabled()) batch_text_.append(frame + BINARY_BODY_OFFSET, len - BINARY_BODY_OFFSET);
+        result_ends[next++] = batch_text_.size();
+    }
+
+    if (!cache_.enabled()) return;
+    size_t begin = 0;
+    next = 0;
+    for (size_t i = 0; i < count; ++i) {
+        if (disposition[i] != Disposition::Evaluated) continue;
+        uint8_t variant = (requests[i].flags & protocol::kWantText) ? CACHE_BINARY_TEXT : CACHE_BINARY;
+        size_t end = result_ends[next++];
+        cache_.insert(requests[i].expr, std::string_view(batch_text_).substr(begin, end - begin), variant);
+        begin = end;
+    }
+}
+
+void RequestProcessor::reject_oversized(Connection& conn, uint32_t request_id, uint8_t flags) {
+    CalcResult result = CalcResult::failure(CalcError::ExpressionTooLong);
+    if (conn.protocol == WireProtocol::Binary) {
+        char frame[kMaxBinaryResponse];
+        conn.out_buf.append(std::string_view(frame, format_binary_response(request_id, result, flags, frame)));
+        ++conn.unrecorded_responses;
+    } else {
+        char line[kMaxResponseLine];
+        queue_response(conn, std::string_view(line, format_response(result, line)));
+    }
+    count_result(result.error);
+    log(conn, LogLevel::Warn, "Rejected", "Expression longer than " + std::to_string(max_expression_) + " bytes");
+}
+
+bool RequestProcessor::update_flow(Connection& conn) {
+    conn.in_buf.release_if_empty();
+    arm_timeout(conn);
+
+    size_t buffered = conn.buffered_bytes();
+    if (buffered != conn.accounted_bytes) {
+        // Unsigned wrap-around makes the same update work when shrinking.
+        buffered_ += buffered - conn.accounted_bytes;
+        total_buffered_.fetch_add(buffered - conn.accounted_bytes, std::memory_order_relaxed);
+        conn.accounted_bytes = buffered;
+    }
+
+    size_t output = conn.output_bytes();
+    bool pause = !conn.read_paused && output >= high_watermark_;
+    bool resume = conn.read_paused && output <= low_watermark_;
+    if (!pause && !resume) return false;
+
+    conn.read_paused = pause;
+    if (resume && conn.input_deferred) defer(conn);
+    if (log_enabled(LogLevel::Info)) {
+        log(conn, LogLevel::Info, pause ? "Paused reading" : "Resumed reading",
+            std::to_string(output) + " bytes queued, " + std::to_string(total_buffered_bytes()) +
+                " bytes buffered in total");
+    }
+    return true;
+}
+
+void RequestProcessor::arm_timeout(Connection& conn) {
+    TimeoutReason reason = TimeoutReason::None;
+    uint64_t since = now_ns_, timeout = 0;
+    if (!conn.mid_request()) conn.request_started_ns = 0;
+
+    if (!conn.out_buf.empty()) {
+        // Stalled output: measured from the last write that made progress,
+        // or from when output started queueing.
+        if (conn.timeout_reason != TimeoutReason::Write) conn.last_sent_ns = now_ns_;
+        reason = TimeoutReason::Write;
+        since = conn.last_sent_ns;
+        timeout = write_timeout_ns_;
+    } else if (conn.request_started_ns != 0) {
+        // A request trickling in, however steadily its bytes arrive.
+        reason = TimeoutReason::Header;
+        since = conn.request_started_ns;
+        timeout = header_timeout_ns_;
+    } else if (conn.pending.empty() && conn.binary_jobs == 0) {
+        reason = TimeoutReason::Idle;
+        timeout = idle_timeout_ns_;
+    }
+
+    conn.timeout_reason = reason;
+    if (timeout == 0) {
+        timers_.cancel(conn.timer);
+        return;
+    }
+    conn.deadline_ns = since + timeout;
+    timers_.arm(conn.timer, conn.deadline_ns);
+}
+
+void RequestProcessor::count_timeout(Connection& conn) {
+    const char* what = "no request in progress";
+    switch (conn.timeout_reason) {
+        case TimeoutReason::Header:
+            metrics_->reaped_header.add();
+            what = "request incomplete";
+            break;
+        case TimeoutReason::Write:
+            metrics_->reaped_write.add();
+            what = "output stalled";
+            break;
+        default:
+            metrics_->reaped_idle.add();
+            break;
+    }
+    log(conn, LogLevel::Info, "Timed out", what);
+}
+
+void RequestProcessor::forget(Connection& conn) {
+    timers_.cancel(conn.timer);
+    buffered_ -= conn.accounted_bytes;
+    total_buffered_.fetch_sub(conn.accounted_bytes, std::memory_order_relaxed);
+    conn.accounted_bytes = 0;
+    metrics_->closed.add();
+}
+
+void RequestProcessor::on_received(Connection& conn, size_t bytes, uint64_t received_ns) {
+    metrics_->received_bytes.add(bytes);
+    conn.last_received_ns = received_ns;
+    if (conn.received_ns == 0) conn.received_ns = received_ns;
+    if (conn.request_started_ns == 0) conn.request_started_ns = received_ns;
+}
+
+void RequestProcessor::on_sent(Connection& conn, size_t bytes) {
+    metrics_->sent_bytes.add(bytes);
+    conn.last_sent_ns = now_ns_;
+    if (conn.unrecorded_responses == 0) return;
+
+    if (conn.received_ns != 0) {
+        metrics_->request_latency.record(monotonic_ns() - conn.received_ns, conn.unrecorded_responses);
+    }
+    conn.unrecorded_responses = 0;
+
+    // Whatever is still unanswered arrived by the latest read at the
+    // earliest; with nothing left, the next read starts the clock afresh.
+    bool idle = conn.in_buf.empty() && !conn.streaming() && conn.pending.empty() && conn.binary_jobs == 0;
+    conn.received_ns = idle ? 0 : conn.last_received_ns;
+}
+
+void RequestProcessor::finish_iteration(uint64_t started_ns) {
+    const ResultCache::Stats& stats = cache_.stats();
+    metrics_->cache_hits.set(stats.hits);
+    metrics_->cache_misses.set(stats.misses);
+    metrics_->cache_evictions.set(stats.evictions);
+    metrics_->cache_entries.set(stats.entries);
+    metrics_->cache_bytes.set(stats.bytes);
+    metrics_->buffered_bytes.set(buffered_);
+    const BlockPool::Stats& pool = blocks_.stats();
+    metrics_->pool_blocks_in_use.set(pool.blocks_in_use);
+    metrics_->pool_bytes_in_use.set(pool.bytes_in_use);
+    metrics_->pool_blocks_cached.set(pool.blocks_cached);
+    metrics_->pool_bytes_cached.set(pool.bytes_cached);
+    metrics_->loop_iteration.record(monotonic_ns() - started_ns);
+}
+
+void RequestProcessor::on_peer_closed(Connection& conn) {
+    if (conn.closing) return;
+    if (conn.input_deferred) {
+        conn.peer_closed = true;
+        return;
+    }
+    log(conn, LogLevel::Info, "Peer closed", "Received EOF");
+
+    // A binary connection can only be left with a truncated frame, which
+    // is dropped, as is the tail of a text expression being skipped;
+    // otherwise a text connection's remainder is its last expression.
+    if (conn.protocol == WireProtocol::Binary || conn.discard_to_delimiter) {
+        conn.in_buf.clear();
+    } else if (conn.streaming()) {
+        conn.stream->finish(conn.in_buf.pending());
+        respond_streamed(conn, true);
+        conn.stream.reset();
+        conn.in_buf.clear();
+    } else if (!conn.in_buf.empty()) {
+        std::string_view expr = conn.in_buf.pending();
+        answer_expressions(conn, &expr, 1, true);
+        conn.in_buf.clear();
+    }
+    conn.closing = true;
+}
+
+void RequestProcessor::answer_expressions(Connection& conn, const std::string_view* exprs, size_t count,
+                                          bool last) {
+    // Cache lookups and offloading are decided first, so that everything
+    // left goes to the calculator in one call; the responses are then
+    // queued in request order. A hit skips evaluation and formatting
+    // entirely. New results are only inserted at the end, because an
+    // insert may invalidate the cached views still waiting to be copied.
+    Disposition disposition[EVAL_BATCH];
+    std::string_view cached[EVAL_BATCH];
+    uint8_t cached_errors[EVAL_BATCH];
+    std::string_view misses[EVAL_BATCH];
+    CalcResult results[EVAL_BATCH];
+    size_t evaluated = 0;
+    for (size_t i = 0; i < count; ++i) {
+        std::string_view expr = exprs[i];
+        if (expr.empty()) {
+            disposition[i] = Disposition::Skipped;
+        } else if (expr.size() > max_expression_) {
+            disposition[i] = Disposition::Oversized;
+        } else if (!(cached[i] = cache_.find(expr, CACHE_TEXT, &cached_errors[i])).empty()) {
+            disposition[i] = Disposition::Cached;
+        } else if (workers_ && expr.size() >= offload_bytes_) {
+            disposition[i] = Disposition::Offloaded;
+        } else {
+            disposition[i] = Disposition::Evaluated;
+            misses[evaluated++] = expr;
+        }
+    }
+    if (evaluated > 0) calc_.try_calculate_batch(misses, evaluated, results);
+
+    char line[kMaxResponseLine];
+    size_t result_ends[EVAL_BATCH];
+    size_t next = 0;
+    batch_text_.clear();
+    for (size_t i = 0; i < count; ++i) {
+        std::string_view expr = exprs[i];
+        switch (disposition[i]) {
+            case Disposition::Skipped:
+                break;
+            case Disposition::Oversized:
+                reject_oversized(conn, 0, 0);
+                break;
+            case Disposition::Cached:
+                queue_response(conn, cached[i]);
+                count_result(static_cast<CalcError>(cached_errors[i]));
+                if (log_enabled(LogLevel::Debug)) {
+                    log(conn, LogLevel::Debug, last ? "Cached (last)" : "Cached",
+                        std::string(expr) + " = " + std::string(cached[i]));
+                }
+                break;
+            case Disposition::Offloaded: {
+                OffloadJob* job = make_job(conn, expr);
+                job->seq = conn.pending_base + (conn.pending.size() - conn.pending_head);
+                conn.pending.push_back({false, {}});
+                metrics_->offloaded.add();
+                workers_->submit(job);
+                break;
+            }
+            case Disposition::Evaluated: {
+                const CalcResult& result = results[next];
+                std::string_view response(line, format_response(result, line));
+                queue_response(conn, response);
+                count_result(result.error);
+
+                if (log_enabled(LogLevel::Debug)) {
+                    if (result) {
+                        log(conn, LogLevel::Debug, last ? "Calculated (last)" : "Calculated",
+                            std::string(expr) + " = " + std::string(response));
+                    } else {
+                        log(conn, LogLevel::Debug, last ? "Exception (last)" : "Exception", response);
+                    }
+                }
+                if (cache_.enabled()) batch_text_.append(response);
+                result_ends[next++] = batch_text_.size();
+                break;
+            }
+        }
+    }
+
+    if (!cache_.enabled()) return;
+    size_t begin = 0;
+    next = 0;
+    for (size_t i = 0; i < count; ++i) {
+        if (disposition[i] != Disposition::Evaluated) continue;
+        size_t end = result_ends[next];
+        cache_.insert(exprs[i], std::string_view(batch_text_).substr(begin, end - begin), CACHE_TEXT,
+                      static_cast<uint8_t>(results[next].error));
+        begin = end;
+        ++next;
+    }
+}
+
+void RequestProcessor::queue_response(Connection& conn, std::string_view response) {
+    if (conn.pending_head == conn.pending.size()) {
+        conn.out_buf.append(response);
+        ++conn.unrecorded_responses;
+    } else {
+        conn.pending.push_back({true, std::string(response)});
+        conn.pending_bytes += response.size();
+    }
+}
+
+void RequestProcessor::count_result(CalcError error) {
+    metrics_->expressions.add();
+    if (error != CalcError::None) metrics_->errors[static_cast<size_t>(error)].add();
+}
+
+OffloadJob* RequestProcessor::make_job(Connection& conn, std::string_view expr) {
+    auto* job = new OffloadJob;
+    job->expr.assign(expr);
+    job->conn_id = conn.id;
+    job->reply_to = completions_.get();
+
+    if (log_enabled(LogLevel::Debug)) {
+        log(conn, LogLevel::Debug, "Offloaded", std::to_string(expr.size()) + " bytes");
+    }
+    return job;
+}
+
+bool RequestProcessor::complete(OffloadJob& job, Connection* conn) {
+    if (cache_.enabled()) {
+        if (!job.binary) {
+            cache_.insert(job.expr, job.response, CACHE_TEXT, static_cast<uint8_t>(job.result.error));
+        } else {
+            uint8_t variant = (job.flags & protocol::kWantText) ? CACHE_BINARY_TEXT : CACHE_BINARY;
+            cache_.insert(job.expr, std::string_view(job.response).substr(BINARY_BODY_OFFSET), variant);
+        }
+    }
+
+    // The connection may have gone away (and its fd been reused) while the
+    // job was running; the backend's generation check catches that.
+    if (!conn) return false;
+    count_result(job.result.error);
+
+    // Binary responses are tagged with their request id and go out as
+    // soon as they are ready.
+    if (job.binary) {
+        --conn->binary_jobs;
+        conn->out_buf.append(job.response);
+        ++conn->unrecorded_responses;
+        if (log_enabled(LogLevel::Debug)) {
+            log(*conn, LogLevel::Debug, "Calculated (offloaded)", "#" + std::to_string(job.request_id));
+        }
+        return true;
+    }
+
+    Connection::PendingResponse& slot = conn->pending[conn->pending_head + (job.seq - conn->pending_base)];
+    slot.ready = true;
+    slot.text = std::move(job.response);
+    conn->pending_bytes += slot.text.size();
+
+    if (log_enabled(LogLevel::Debug)) {
+        log(*conn, LogLevel::Debug, "Calculated (offloaded)", slot.text);
+    }
+
+    while (conn->pending_head < conn->pending.size() && conn->pending[conn->pending_head].ready) {
+        conn->out_buf.append(conn->pending[conn->pending_head].text);
+        ++conn->unrecorded_responses;
+        conn->pending_bytes -= conn->pending[conn->pending_head].text.size();
+        ++conn->pending_head;
+        ++conn->pending_base;
+    }
+    if (conn->pending_head == conn->pending.size()) {
+        // Drained: give the storage back rather than keep the peak.
+        std::vector<Connection::PendingResponse>().swap(conn->pending);
+        conn->pending_head = 0;
+    }
+    return true;
+}
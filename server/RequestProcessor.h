@@ -0,0 +1,190 @@
+#pragma once
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include "BlockPool.h"
+#include "Connection.h"
+#include "ICalc.h"
+#include "Logger.h"
+#include "Metrics.h"
+#include "ResultCache.h"
+#include "ServerOptions.h"
+#include "TimerWheel.h"
+#include "WorkerPool.h"
+
+// Everything a reactor does between receiving bytes and having response
+// bytes to send: framing, the result cache, evaluation, offloading to the
+// worker pool and keeping responses in request order. The I/O backends
+// only move bytes in and out of Connection buffers.
+class RequestProcessor {
+public:
+    explicit RequestProcessor(const ServerOptions& options);
+
+    RequestProcessor(const RequestProcessor&) = delete;
+    RequestProcessor& operator=(const RequestProcessor&) = delete;
+
+    // Also attaches conn's buffers to this reactor's BlockPool, so the
+    // processor must outlive the connections it has seen.
+    void on_connected(Connection& conn, uint64_t id, const sockaddr_in& addr);
+
+    // Answers the complete requests in conn.in_buf, as many as the current
+    // turn allows; the rest stay buffered and conn.input_deferred is set.
+    // The first bytes of a connection decide between the text and binary
+    // protocols.
+    void on_input(Connection& conn);
+
+    // The peer shut down its side: whatever is left in the buffer is the
+    // last expression, and the connection starts closing. With requests
+    // deferred, that waits until on_input() has answered them.
+    void on_peer_closed(Connection& conn);
+
+    // Backends give each connection with input a turn: start_turn(), then
+    // reads and on_input() until the socket is drained or the turn's
+    // budget is spent. A connection whose turn ended with work left is
+    // passed to defer() and gets its next turn from run_ready(), after the
+    // others queued before it.
+    void start_turn(Connection& conn) { conn.turn_budget = expression_budget_; }
+    void defer(Connection& conn);
+    bool has_ready() const { return !ready_.empty(); }
+
+    // One more turn, via resume, for each connection queued so far; those
+    // deferred again go to the back. lookup is as for drain_completions().
+    template <typename Lookup, typename Resume>
+    void run_ready(Lookup&& lookup, Resume&& resume) {
+        for (size_t n = ready_.size(); n > 0; --n) {
+            uint64_t id = ready_.front();
+            ready_.pop_front();
+            Connection* conn = lookup(id);
+            if (!conn) continue;
+            conn->ready_queued = false;
+            resume(*conn);
+        }
+    }
+
+    // Records conn's buffered bytes, applies the output watermarks, returns
+    // an emptied input buffer to the pool and re-arms conn's timeout. A
+    // connection whose reading resumes with requests deferred is queued.
+    // Backends call it after each round of I/O on a connection and act on
+    // conn.read_paused; returns true when that flag changed.
+    bool update_flow(Connection& conn);
+
+    // Drops conn's bytes from the totals and cancels its timeout; call
+    // before releasing it.
+    void forget(Connection& conn);
+
+    // Metrics hooks. Backends report bytes read (stamped with the time the
+    // current loop iteration started) and written, and the end of each
+    // iteration; on_sent() also records the latency of the responses that
+    // were queued since the previous write.
+    void on_received(Connection& conn, size_t bytes, uint64_t received_ns);
+    void on_sent(Connection& conn, size_t bytes);
+    void finish_iteration(uint64_t started_ns);
+
+    // Bytes held in connection buffers by this reactor and by all of them.
+    size_t buffered_bytes() const { return buffered_; }
+    static size_t total_buffered_bytes() { return total_buffered_.load(std::memory_order_relaxed); }
+
+    // eventfd signalled by the worker pool, or -1 when there is none.
+    int completion_fd() const { return completions_ ? completions_->fd() : -1; }
+
+    // Hands finished offloaded jobs back to their connections. lookup maps
+    // a connection id to the live Connection (nullptr if it has gone away);
+    // on_output is called for each connection that received output.
+    template <typename Lookup, typename OnOutput>
+    void drain_completions(Lookup&& lookup, OnOutput&& on_output) {
+        completions_->clear_signal();
+        while (OffloadJob* job = completions_->pop()) {
+            std::unique_ptr<OffloadJob> owned(job);
+            Connection* conn = lookup(job->conn_id);
+            if (complete(*job, conn)) on_output(*conn);
+        }
+    }
+
+    // Starts a loop iteration at now_ns. Connections whose timeout has
+    // passed are handed to reap, which must close them. Backends call it
+    // before handling the iteration's events and wait for new events no
+    // longer than until next_timer_ns(), so the loop reads the clock once
+    // per iteration rather than per event.
+    template <typename Reap>
+    void expire_timers(uint64_t now_ns, Reap&& reap) {
+        now_ns_ = now_ns;
+        timers_.advance(now_ns, [&](TimerWheel::Node& node) {
+            Connection& conn = *static_cast<Connection*>(node.owner);
+            if (conn.deadline_ns > now_ns) {
+                timers_.schedule(node, conn.deadline_ns);
+                return;
+            }
+            count_timeout(conn);
+            reap(conn);
+        });
+    }
+
+    // Absolute CLOCK_MONOTONIC time of the next timer check, or 0 if no
+    // connection has a timeout.
+    uint64_t next_timer_ns() const { return timers_.next_due_ns(); }
+
+    bool log_enabled(LogLevel level) const { return Logger::instance().enabled(level); }
+    void log(const Connection& conn, LogLevel level, std::string_view prefix, std::string_view message) {
+        Logger::instance().log(*log_ring_, level, conn.peer, prefix, message);
+    }
+
+    const ResultCache::Stats& cache_stats() const { return cache_.stats(); }
+    const BlockPool::Stats& pool_stats() const { return blocks_.stats(); }
+
+private:
+    bool negotiate(Connection& conn);
+    void process_lines(Connection& conn);
+    bool stream_input(Connection& conn);
+    void respond_streamed(Connection& conn, bool last);
+    void process_frames(Connection& conn);
+    void reject_oversized(Connection& conn, uint32_t request_id, uint8_t flags);
+
+    // A binary request cut from in_buf, waiting for its batch.
+    struct FrameRequest {
+        uint32_t id = 0;
+        uint8_t flags = 0;
+        std::string_view expr;
+    };
+    // How a batch answers each of its requests.
+    enum class Disposition : uint8_t { Skipped, Oversized, Cached, Offloaded, Evaluated };
+    bool cut_frame(Connection& conn, FrameRequest& request);
+    void answer_frames(Connection& conn, const FrameRequest* requests, size_t count);
+    void answer_expressions(Connection& conn, const std::string_view* exprs, size_t count, bool last);
+    void queue_response(Connection& conn, std::string_view response);
+    void count_result(CalcError error);
+    void arm_timeout(Connection& conn);
+    void count_timeout(Connection& conn);
+    OffloadJob* make_job(Connection& conn, std::string_view expr);
+    bool complete(OffloadJob& job, Connection* conn);
+
+    CalcImpl calc_;
+    // Responses evaluated by the current batch, held until they go into
+    // the cache.
+    std::string batch_text_;
+    BlockPool blocks_;
+    ResultCache cache_;
+    WorkerPool* workers_;
+    size_t offload_bytes_;
+    size_t high_watermark_;
+    size_t low_watermark_;
+    size_t max_expression_;
+    bool streaming_;
+    size_t expression_budget_;
+    // Connection ids in turn order; see run_ready().
+    std::deque<uint64_t> ready_;
+    TimerWheel timers_;
+    uint64_t idle_timeout_ns_;
+    uint64_t header_timeout_ns_;
+    uint64_t write_timeout_ns_;
+    // Start of the current loop iteration, from expire_timers().
+    uint64_t now_ns_ = 0;
+    size_t buffered_ = 0;
+    static std::atomic<size_t> total_buffered_;
+    std::unique_ptr<CompletionQueue> completions_;
+    LogRing* log_ring_;
+    ReactorMetrics* metrics_;
+};
@@ -0,0 +1,141 @@
+#include "ResultCache.h"
+
+#include <cstring>
+
+namespace {
+
+constexpr size_t kMinSlots = 16;
+
+inline uint64_t mix(uint64_t h) {
+    h ^= h >> 32;
+    h *= 0xd6e8feb86659fd93ull;
+    h ^= h >> 32;
+    return h;
+}
+
+}
+
+ResultCache::ResultCache(size_t budget_bytes) {
+    stats_.budget = budget_bytes;
+    if (budget_bytes == 0) return;
+
+    // Spend roughly a quarter of the budget on the slot array.
+    size_t slots = kMinSlots;
+    while (slots * 2 * sizeof(Slot) * 4 <= budget_bytes) slots *= 2;
+
+    slots_.resize(slots);
+    mask_ = slots - 1;
+    max_entries_ = slots / 4 * 3;
+    stats_.bytes = slots * sizeof(Slot);
+}
+
+uint64_t ResultCache::hash(std::string_view key, uint8_t variant) {
+    uint64_t h = 0x9e3779b97f4a7c15ull ^ key.size() ^ (static_cast<uint64_t>(variant) << 56);
+    const char* p = key.data();
+    size_t n = key.size();
+
+    for (; n >= 8; p += 8, n -= 8) {
+        uint64_t chunk;
+        std::memcpy(&chunk, p, 8);
+        h = mix(h ^ chunk) * 0x9e3779b97f4a7c15ull;
+    }
+    if (n > 0) {
+        uint64_t chunk = 0;
+        std::memcpy(&chunk, p, n);
+        h = mix(h ^ chunk) * 0x9e3779b97f4a7c15ull;
+    }
+    return mix(h);
+}
+
+std::string_view ResultCache::find(std::string_view key, uint8_t variant, uint8_t* tag) {
+    if (!enabled()) return {};
+
+    uint64_t h = hash(key, variant);
+    for (size_t i = home(h);; i = (i + 1) & mask_) {
+        Slot& slot = slots_[i];
+        if (!slot.used()) break;
+        if (matches(slot, h, key, variant)) {
+            slot.referenced = true;
+            if (tag) *tag = slot.tag;
+            ++stats_.hits;
+            return std::string_view(slot.data.get() + slot.key_len, slot.value_len);
+        }
+    }
+
+    ++stats_.misses;
+    return {};
+}
+
+void ResultCache::insert(std::string_view key, std::string_view response, uint8_t variant, uint8_t tag) {
+    if (!enabled()) return;
+
+    // Neither an entry that could never fit nor one already present may
+    // evict anything.
+    size_t footprint = key.size() + response.size();
+    if (slots_.size() * sizeof(Slot) + footprint > stats_.budget) return;
+
+    uint64_t h = hash(key, variant);
+    for (size_t i = home(h); slots_[i].used(); i = (i + 1) & mask_) {
+        if (matches(slots_[i], h, key, variant)) return;
+    }
+
+    while (stats_.entries > 0 &&
+           (stats_.bytes + footprint > stats_.budget || stats_.entries + 1 > max_entries_)) {
+        evict_one();
+    }
+
+    // Eviction shifts entries around, so look for the free slot afterwards.
+    size_t i = home(h);
+    while (slots_[i].used()) i = (i + 1) & mask_;
+
+    Slot& slot = slots_[i];
+    slot.data.reset(new char[footprint]);
+    std::memcpy(slot.data.get(), key.data(), key.size());
+    std::memcpy(slot.data.get() + key.size(), response.data(), response.size());
+    slot.hash = h;
+    slot.key_len = static_cast<uint32_t>(key.size());
+    slot.value_len = static_cast<uint32_t>(response.size());
+    slot.referenced = false;
+    slot.variant = variant;
+    slot.tag = tag;
+
+    ++stats_.entries;
+    ++stats_.insertions;
+    stats_.bytes += footprint;
+}
+
+void ResultCache::evict_one() {
+    while (true) {
+        Slot& slot = slots_[hand_];
+        size_t index = hand_;
+        hand_ = (hand_ + 1) & mask_;
+
+        if (!slot.used()) continue;
+        if (slot.referenced) {
+            slot.referenced = false;
+            continue;
+        }
+
+        erase_at(index);
+        ++stats_.evictions;
+        return;
+    }
+}
+
+void ResultCache::erase_at(size_t index) {
+    stats_.bytes -= slots_[index].footprint();
+    --stats_.entries;
+    slots_[index] = Slot{};
+
+    // Backward-shift the rest of the probe run into the hole whenever the
+    // entry's home slot does not lie cyclically in (hole, current].
+    size_t hole = index;
+    for (size_t i = (index + 1) & mask_; slots_[i].used(); i = (i + 1) & mask_) {
+        size_t h = home(slots_[i].hash);
+        bool stays = hole <= i ? (hole < h && h <= i) : (hole < h || h <= i);
+        if (stays) continue;
+        slots_[hole] = std::move(slots_[i]);
+        slots_[i] = Slot{};
+        hole = i;
+    }
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+// Bounded cache from expression bytes to the complete response line.
+//
+// Open addressing with linear probing over a power-of-two slot array; each
+// entry owns one heap block holding key and response back to back. When
+// either the byte budget or the 75% load limit would be exceeded, entries
+// are evicted with the CLOCK policy: the hand skips (and clears) recently
+// referenced entries and evicts the first unreferenced one. Deletion uses
+// backward shifting, so probing never needs tombstones.
+//
+// The budget covers the slot array as well as the entries. A cache built
+// with a zero budget is disabled and find() always misses. Entries are
+// keyed by (variant, expression), so responses rendered for different wire
+// formats never collide. Each entry also carries one caller-defined tag
+// byte, which costs no space in the slot.
+class ResultCache {
+public:
+    struct Stats {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t insertions = 0;
+        uint64_t evictions = 0;
+        size_t entries = 0;
+        size_t bytes = 0;
+        size_t budget = 0;
+    };
+
+    explicit ResultCache(size_t budget_bytes = 0);
+
+    bool enabled() const { return !slots_.empty(); }
+
+    // Returns the cached response for key, or an empty view on a miss. The
+    // view stays valid until the next insert(). On a hit the entry's tag is
+    // stored through tag if given.
+    std::string_view find(std::string_view key, uint8_t variant = 0, uint8_t* tag = nullptr);
+
+    void insert(std::string_view key, std::string_view response, uint8_t variant = 0, uint8_t tag = 0);
+
+    const Stats& stats() const { return stats_; }
+
+    static uint64_t hash(std::string_view key, uint8_t variant = 0);
+
+private:
+    struct Slot {
+        std::unique_ptr<char[]> data;
+        uint64_t hash = 0;
+        uint32_t key_len = 0;
+        uint32_t value_len = 0;
+        bool referenced = false;
+        uint8_t variant = 0;
+        uint8_t tag = 0;
+
+        bool used() const { return data != nullptr; }
+        size_t footprint() const { return key_len + value_len; }
+    };
+
+    size_t home(uint64_t h) const { return h & mask_; }
+    static bool matches(const Slot& slot, uint64_t h, std::string_view key, uint8_t variant) {
+        return slot.hash == h && slot.variant == variant && slot.key_len == key.size() &&
+               std::memcmp(slot.data.get(), key.data(), key.size()) == 0;
+    }
+    void evict_one();
+    void erase_at(size_t index);
+
+    std::vector<Slot> slots_;
+    size_t mask_ = 0;
+    size_t max_entries_ = 0;
+    size_t hand_ = 0;
+    Stats stats_;
+};
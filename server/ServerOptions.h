@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+class WorkerPool;
+
+enum class Backend { Epoll, Uring };
+
+struct ServerOptions {
+    int port = 0;
+    bool reuse_port = false;
+    Backend backend = Backend::Epoll;
+    size_t cache_bytes = 0;
+    // Expressions of at least offload_bytes are evaluated on the pool.
+    WorkerPool* workers = nullptr;
+    size_t offload_bytes = 64 * 1024;
+
+    // A connection stops being read once this many response bytes are
+    // waiting for it, and resumes at or below the low watermark.
+    size_t output_high_watermark = 1024 * 1024;
+    size_t output_low_watermark = 256 * 1024;
+    // Longer requests are answered with ExpressionTooLong and skipped
+    // without being buffered.
+    size_t max_expression_bytes = 16 * 1024 * 1024;
+    // Evaluate unterminated text expressions incrementally as bytes arrive.
+    // Their bytes are gone by the time they complete, so streamed
+    // expressions bypass the result cache and the worker pool; off by
+    // default to keep those working for requests split across reads.
+    bool streaming = false;
+    // Evaluate over exact int64 rationals where possible (see
+    // CalcProgram::execute_exact()); the worker pool is set up to match.
+    bool exact = false;
+
+    // Fairness between connections: a connection's turn ends after it has
+    // read read_budget_bytes or answered expression_budget requests, and
+    // it continues after every other connection with work has had one.
+    // Zero means no limit.
+    size_t read_budget_bytes = 64 * 1024;
+    size_t expression_budget = 64;
+
+    // Connections are closed after idle_timeout_ms without a request in
+    // progress, when a request takes longer than header_timeout_ms to
+    // arrive in full, or when queued output makes no progress for
+    // write_timeout_ms. Zero disables a timeout.
+    uint64_t idle_timeout_ms = 60000;
+    uint64_t header_timeout_ms = 30000;
+    uint64_t write_timeout_ms = 30000;
+};
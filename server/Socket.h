@@ -0,0 +1,51 @@
+#pragma once
+
+#include <arpa/inet.h>
+#include <cstdio>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <unistd.h>
+
+inline int set_nonblocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    return (flags == -1) ? -1 : fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+// Creates a TCP socket listening on address (all interfaces by default).
+inline int create_listener(int port, bool reuse_port, bool nonblocking, in_addr_t address = INADDR_ANY) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) throw std::runtime_error("Failed to create socket");
+
+    if (nonblocking) set_nonblocking(fd);
+    int opt = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    if (reuse_port && setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) < 0) {
+        close(fd);
+        throw std::runtime_error("Failed to set SO_REUSEPORT");
+    }
+
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(address);
+    addr.sin_port = htons(port);
+
+    if (bind(fd, (sockaddr*)&addr, sizeof(addr)) < 0) {
+        close(fd);
+        throw std::runtime_error("Failed to bind socket");
+    }
+
+    if (listen(fd, SOMAXCONN) < 0) {
+        close(fd);
+        throw std::runtime_error("Failed to listen on socket");
+    }
+    return fd;
+}
+
+// "ip:port" for log lines; buf should hold at least 22 bytes.
+inline void format_peer(const sockaddr_in& addr, char* buf, size_t size) {
+    char ip[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &addr.sin_addr, ip, sizeof(ip));
+    snprintf(buf, size, "%s:%u", ip, ntohs(addr.sin_port));
+}
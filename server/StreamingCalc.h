@@ -0,0 +1,273 @@
+#pragma once
+
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <string_view>
+
+#include "CalcResult.h"
+#include "CharScan.h"
+#include "Rational.h"
+
+// Resumable evaluator for an expression that arrives in pieces. It keeps
+// only the running sum, the pending product term and the pending
+// operators; the one thing it cannot fold early is an unfinished number,
+// whose bytes the caller keeps and presents again with the next piece, so
+// the state stays O(1) however long the expression gets.
+//
+// Results, including which error wins and its position, match CalcImpl on
+// the complete expression: an invalid character anywhere takes priority,
+// then the first division or modulo by zero before any syntax error, then
+// the syntax error itself. In exact mode the running values are also kept
+// as rationals for as long as they stay exact.
+class StreamingCalc {
+public:
+    void set_exact(bool exact) { exact_mode_ = exact; }
+
+    // Feeds the expression bytes in data, which starts with the bytes held
+    // back by the previous call. Stops at the first delim, which ends the
+    // expression and sets complete. Returns how many bytes of data were
+    // consumed (including the delimiter); the rest must be passed again.
+    size_t feed(std::string_view data, char delim, bool& complete) {
+        const char* hit = charscan::find_byte(data.data() + held_, data.size() - held_, delim);
+        complete = hit != nullptr;
+        size_t limit = complete ? static_cast<size_t>(hit - data.data()) : data.size();
+
+        scan(data, limit);
+
+        if (complete) {
+            end_expression(data, limit);
+            base_ += limit;
+            held_ = 0;
+            return limit + 1;
+        }
+
+        size_t consumed = limit;
+        held_ = 0;
+        if (state_ == State::Number && error_.ok() && !invalid_) {
+            consumed = token_start_;
+            held_ = limit - token_start_;
+            token_start_ = 0;
+        }
+        base_ += consumed;
+        return consumed;
+    }
+
+    // Ends the expression at the end of data (the peer closed).
+    void finish(std::string_view data) {
+        scan(data, data.size());
+        end_expression(data, data.size());
+    }
+
+    // Bytes of the current expression seen so far.
+    size_t length() const { return base_ + held_; }
+    bool active() const { return length() > 0; }
+
+    // Valid once feed() has reported completion or finish() has run.
+    const CalcResult& result() const { return result_; }
+
+private:
+    enum class State : uint8_t { Operand, AfterMinus, Number, Operator };
+
+    static bool is_digit(char c) { return c >= '0' && c <= '9'; }
+    static bool is_space(char c) { return c == ' ' || (c >= '\t' && c <= '\r'); }
+
+    void scan(std::string_view data, size_t limit) {
+        size_t start = held_;
+        if (!invalid_) {
+            size_t bad = charscan::find_invalid(data.data() + start, limit - start);
+            if (bad < limit - start) {
+                invalid_ = true;
+                result_ = CalcResult::failure(CalcError::InvalidCharacter, base_ + start + bad, data[start + bad]);
+            }
+        }
+        if (invalid_ || !error_) return;
+
+        for (size_t i = start; i < limit; ++i) {
+            char c = data[i];
+            switch (state_) {
+                case State::Operand:
+                    if (is_space(c)) break;
+                    if (c == '-') {
+                        negative_ = true;
+                        state_ = State::AfterMinus;
+                        break;
+                    }
+                    [[fallthrough]];
+                case State::AfterMinus:
+                    if (!is_digit(c) && c != '.') {
+                        error_ = CalcResult::failure(CalcError::ExpectedDigit, base_ + i);
+                        return;
+                    }
+                    token_start_ = i;
+                    has_decimal_ = c == '.';
+                    state_ = State::Number;
+                    break;
+                case State::Number:
+                    if (is_digit(c)) break;
+                    if (c == '.' && !has_decimal_) {
+                        has_decimal_ = true;
+                        break;
+                    }
+                    if (!apply_number(data, i)) return;
+                    state_ = State::Operator;
+                    [[fallthrough]];
+                case State::Operator:
+                    if (is_space(c)) break;
+                    if (!apply_operator(c)) {
+                        error_ = CalcResult::failure(CalcError::UnexpectedCharacters, base_ + i);
+                        return;
+                    }
+                    state_ = State::Operand;
+                    break;
+            }
+        }
+    }
+
+    bool apply_number(std::string_view data, size_t end) {
+        const char* p = data.data() + token_start_;
+        size_t n = end - token_start_;
+
+        double value;
+        uint64_t digits;
+        if (!has_decimal_ && n < 8) {
+            charscan::parse_digits8(p, n, digits);
+            value = static_cast<double>(digits);
+        } else {
+            auto res = std::from_chars(p, p + n, value);
+            if (res.ec != std::errc() || res.ptr != p + n) {
+                error_ = CalcResult::failure(CalcError::InvalidNumber, base_ + token_start_);
+                return false;
+            }
+        }
+        if (negative_) value = -value;
+        negative_ = false;
+
+        switch (pending_mul_) {
+            case '*':
+                term_ *= value;
+                break;
+            case '/':
+                if (std::abs(value) < std::numeric_limits<double>::epsilon()) {
+                    error_ = CalcResult::failure(CalcError::DivisionByZero);
+                    return false;
+                }
+                term_ /= value;
+                break;
+            case '%':
+                if (std::abs(value) < std::numeric_limits<double>::epsilon()) {
+                    error_ = CalcResult::failure(CalcError::ModuloByZero);
+                    return false;
+                }
+                term_ = std::fmod(term_, value);
+                break;
+            default:
+                term_ = value;
+                break;
+        }
+        if (exact_mode_ && exact_) apply_exact(value);
+        pending_mul_ = 0;
+        return true;
+    }
+
+    // Zero divisors have been turned down by the double path already.
+    void apply_exact(double value) {
+        Rational r;
+        if (!Rational::from_double(value, r)) {
+            exact_ = false;
+            return;
+        }
+        switch (pending_mul_) {
+            case '*':
+                exact_ = Rational::mul(term_exact_, r);
+                break;
+            case '/':
+                exact_ = Rational::div(term_exact_, r);
+                break;
+            case '%':
+                exact_ = Rational::mod(term_exact_, r);
+                break;
+            default:
+                term_exact_ = r;
+                break;
+        }
+    }
+
+    bool apply_operator(char c) {
+        if (c == '*' || c == '/' || c == '%') {
+            pending_mul_ = c;
+            return true;
+        }
+        if (c == '+' || c == '-') {
+            fold_sum();
+            pending_add_ = c;
+            return true;
+        }
+        return false;
+    }
+
+    void fold_sum() {
+        if (pending_add_ == '+') {
+            sum_ += term_;
+        } else if (pending_add_ == '-') {
+            sum_ -= term_;
+        } else {
+            sum_ = term_;
+        }
+        if (!exact_mode_ || !exact_) return;
+        if (pending_add_ == '+') {
+            exact_ = Rational::add(sum_exact_, term_exact_);
+        } else if (pending_add_ == '-') {
+            exact_ = Rational::sub(sum_exact_, term_exact_);
+        } else {
+            sum_exact_ = term_exact_;
+        }
+    }
+
+    void end_expression(std::string_view data, size_t limit) {
+        if (invalid_) return;
+        if (error_ && state_ == State::Number) {
+            apply_number(data, limit);
+            state_ = State::Operator;
+        }
+        if (!error_) {
+            result_ = error_;
+            return;
+        }
+
+        size_t end = base_ + limit;
+        if (state_ == State::Operand) {
+            result_ = CalcResult::failure(CalcError::ExpectedNumber, end);
+        } else if (state_ == State::AfterMinus) {
+            result_ = CalcResult::failure(CalcError::ExpectedDigit, end);
+        } else {
+            fold_sum();
+            if (exact_mode_ && exact_) {
+                result_ = CalcResult::success(sum_exact_);
+            } else {
+                result_ = std::isinf(sum_) ? CalcResult::failure(CalcError::Overflow) : CalcResult::success(sum_);
+            }
+        }
+    }
+
+    State state_ = State::Operand;
+    bool negative_ = false;
+    bool has_decimal_ = false;
+    bool invalid_ = false;
+    char pending_add_ = 0;
+    char pending_mul_ = 0;
+    double sum_ = 0.0;
+    double term_ = 0.0;
+    // The same values as rationals while exact_ holds.
+    bool exact_mode_ = false;
+    bool exact_ = true;
+    Rational sum_exact_;
+    Rational term_exact_;
+    // Expression offset of data[0], and the held-back bytes at its front.
+    size_t base_ = 0;
+    size_t held_ = 0;
+    size_t token_start_ = 0;
+    CalcResult error_;
+    CalcResult result_;
+};
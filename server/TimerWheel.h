@@ -0,0 +1,156 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Hierarchical timing wheel (Varghese & Lauck) with kLevels levels of
+// kSlots slots each. A timer lives in an intrusive list hanging off the slot
+// of its due tick, at the coarsest level whose span still separates it from
+// the current tick; when a level wraps, the next slot of the level above is
+// redistributed into the finer levels. Scheduling, cancelling and firing
+// are O(1), and nothing allocates.
+//
+// With 100 ms ticks the four levels span about 19 days. Later deadlines
+// are clamped to the horizon and fire early; owners are expected to check
+// the real deadline on expiry and schedule again.
+//
+// Time is whatever the owner passes to advance(): the wheel never reads a
+// clock itself.
+class TimerWheel {
+public:
+    static constexpr unsigned kLevelBits = 6;
+    static constexpr size_t kSlots = size_t{1} << kLevelBits;
+    static constexpr unsigned kLevels = 4;
+
+    struct Node {
+        Node* prev = nullptr;
+        Node* next = nullptr;
+        uint64_t due = 0;  // in ticks
+        void* owner = nullptr;
+
+        bool linked() const { return next != nullptr; }
+    };
+
+    explicit TimerWheel(uint64_t tick_ns) : tick_ns_(tick_ns) {
+        for (auto& level : slots_) {
+            for (Node& head : level) head.prev = head.next = &head;
+        }
+    }
+
+    TimerWheel(const TimerWheel&) = delete;
+    TimerWheel& operator=(const TimerWheel&) = delete;
+
+    size_t size() const { return size_; }
+
+    // (Re)schedules node to fire at the first tick at or after due_ns. A
+    // deadline that has already passed fires on the next tick.
+    void schedule(Node& node, uint64_t due_ns) {
+        cancel(node);
+        uint64_t tick = (due_ns + tick_ns_ - 1) / tick_ns_;
+        if (tick <= current_) tick = current_ + 1;
+        if (tick - current_ >= kHorizon) tick = current_ + kHorizon - 1;
+        node.due = tick;
+        insert(node);
+        ++size_;
+    }
+
+    // Makes sure node fires no later than due_ns. An earlier schedule is
+    // left alone, so refreshing a deadline that only ever moves later
+    // costs nothing until the timer fires.
+    void arm(Node& node, uint64_t due_ns) {
+        if (!node.linked() || (due_ns + tick_ns_ - 1) / tick_ns_ < node.due) schedule(node, due_ns);
+    }
+
+    void cancel(Node& node) {
+        if (!node.linked()) return;
+        unlink(node);
+        --size_;
+    }
+
+    // Moves time forward to now_ns and calls fn(Node&) for every timer that
+    // came due, already unlinked. fn may schedule or cancel any timer.
+    template <typename Fn>
+    void advance(uint64_t now_ns, Fn&& fn) {
+        uint64_t target = now_ns / tick_ns_;
+        while (current_ < target && size_ > 0) {
+            ++current_;
+            for (unsigned level = 1; level < kLevels; ++level) {
+                if (current_ & ((uint64_t{1} << (kLevelBits * level)) - 1)) break;
+                cascade(level);
+            }
+
+            Node expired;
+            expired.prev = expired.next = &expired;
+            splice(slots_[0][current_ & (kSlots - 1)], expired);
+            while (expired.next != &expired) {
+                Node& node = *expired.next;
+                unlink(node);
+                --size_;
+                fn(node);
+            }
+        }
+        // Nothing pending: no need to step through the idle ticks.
+        if (current_ < target) current_ = target;
+    }
+
+    // When advance() next has work to do: the earliest non-empty tick of
+    // the finest level, or the next cascade if that comes first. Zero when
+    // no timer is scheduled.
+    uint64_t next_due_ns() const {
+        if (size_ == 0) return 0;
+        uint64_t wrap = (current_ | (kSlots - 1)) + 1;
+        for (uint64_t tick = current_ + 1; tick < wrap; ++tick) {
+            const Node& head = slots_[0][tick & (kSlots - 1)];
+            if (head.next != &head) return tick * tick_ns_;
+        }
+        return wrap * tick_ns_;
+    }
+
+private:
+    static constexpr uint64_t kHorizon = uint64_t{1} << (kLevelBits * kLevels);
+
+    void insert(Node& node) {
+        uint64_t delta = node.due > current_ ? node.due - current_ : 0;
+        unsigned level = 0;
+        while (level + 1 < kLevels && delta >= (uint64_t{1} << (kLevelBits * (level + 1)))) ++level;
+        Node& head = slots_[level][(node.due >> (kLevelBits * level)) & (kSlots - 1)];
+        node.prev = head.prev;
+        node.next = &head;
+        head.prev->next = &node;
+        head.prev = &node;
+    }
+
+    static void unlink(Node& node) {
+        node.prev->next = node.next;
+        node.next->prev = node.prev;
+        node.prev = node.next = nullptr;
+    }
+
+    // Moves the whole list at from onto the empty list at to.
+    static void splice(Node& from, Node& to) {
+        if (from.next == &from) return;
+        to.next = from.next;
+        to.prev = from.prev;
+        to.next->prev = &to;
+        to.prev->next = &to;
+        from.prev = from.next = &from;
+    }
+
+    // Re-inserts the timers of the current slot of level, which are now
+    // close enough to belong to a finer level.
+    void cascade(unsigned level) {
+        Node pending;
+        pending.prev = pending.next = &pending;
+        splice(slots_[level][(current_ >> (kLevelBits * level)) & (kSlots - 1)], pending);
+        while (pending.next != &pending) {
+            Node& node = *pending.next;
+            unlink(node);
+            insert(node);
+        }
+    }
+
+    uint64_t tick_ns_;
+    uint64_t current_ = 0;
+    size_t size_ = 0;
+    Node slots_[kLevels][kSlots];
+};
@@ -0,0 +1,324 @@
+#include "UringServer.h"
+#include "Socket.h"
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <poll.h>
+#include <unistd.h>
+
+constexpr unsigned RING_ENTRIES = 4096;
+constexpr uint16_t BUFFER_GROUP = 0;
+constexpr unsigned BUFFER_COUNT = 1024;
+constexpr unsigned BUFFER_SIZE = 4096;
+
+static void log_errno(const char* what, int err) {
+    std::cerr << what << ": " << strerror(err) << "\n";
+}
+
+UringServer::UringServer(const ServerOptions& options)
+    : server_fd(create_listener(options.port, options.reuse_port, false)),
+      ring(RING_ENTRIES),
+      buffers(ring, BUFFER_GROUP, BUFFER_COUNT, BUFFER_SIZE),
+      processor(options),
+      read_budget(options.read_budget_bytes ? options.read_budget_bytes : SIZE_MAX) {
+    arm_accept();
+    if (processor.completion_fd() != -1) arm_completions();
+
+    std::cout << "Server listening on port " << options.port << " (io_uring)...\n";
+}
+
+UringServer::~UringServer() {
+    clients.for_each([](int fd, Client&) { close(fd); });
+    if (server_fd != -1) close(server_fd);
+}
+
+UringServer::Client* UringServer::lookup(uint64_t user_data) {
+    int fd = ConnectionTable<Client>::fd_of(user_data);
+    Client* client = clients.get(fd);
+    if (!client || ((client->id ^ user_data) & kIdMask) != 0) return nullptr;
+    return client;
+}
+
+void UringServer::arm_accept() {
+    io_uring_sqe* sqe = ring.get_sqe();
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = server_fd;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->user_data = tag(Op::Accept, 0);
+}
+
+void UringServer::arm_recv(int fd, Client& client) {
+    io_uring_sqe* sqe = ring.get_sqe();
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = buffers.group();
+    sqe->user_data = tag(Op::Recv, client.id);
+    client.recv_armed = true;
+    client.recv_cancelled = false;
+}
+
+bool UringServer::wants_input(const Client& client) const {
+    if (client.aborted || client.closing || client.peer_closed || client.read_paused) return false;
+    // Deferred requests past the read budget: the kernel holds the rest
+    // until this connection has caught up in its turns.
+    return !client.input_deferred || client.in_buf.size() < read_budget;
+}
+
+void UringServer::arm_completions() {
+    io_uring_sqe* sqe = ring.get_sqe();
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = processor.completion_fd();
+    sqe->poll32_events = POLLIN;
+    sqe->len = IORING_POLL_ADD_MULTI;
+    sqe->user_data = tag(Op::Completions, 0);
+}
+
+void UringServer::arm_timer() {
+    // One timeout is kept in flight and only ever moved earlier; one that
+    // fires early just wakes the loop once more.
+    uint64_t due = processor.next_timer_ns();
+    if (due == 0 || (timer_armed_ns != 0 && timer_armed_ns <= due)) return;
+
+    timer_spec.tv_sec = static_cast<int64_t>(due / 1000000000);
+    timer_spec.tv_nsec = static_cast<long long>(due % 1000000000);
+    io_uring_sqe* sqe = ring.get_sqe();
+    if (timer_armed_ns == 0) {
+        // len 0: a pure deadline, not completed by other CQEs.
+        sqe->opcode = IORING_OP_TIMEOUT;
+        sqe->addr = reinterpret_cast<uint64_t>(&timer_spec);
+        sqe->timeout_flags = IORING_TIMEOUT_ABS;
+        sqe->user_data = tag(Op::Timer, 0);
+    } else {
+        // If the timeout has fired meanwhile the update fails, and the
+        // timeout's own completion clears timer_armed_ns.
+        sqe->opcode = IORING_OP_TIMEOUT_REMOVE;
+        sqe->addr = tag(Op::Timer, 0);
+        sqe->addr2 = reinterpret_cast<uint64_t>(&timer_spec);
+        sqe->timeout_flags = IORING_TIMEOUT_UPDATE | IORING_TIMEOUT_ABS;
+        sqe->flags = IOSQE_CQE_SKIP_SUCCESS;
+    }
+    timer_armed_ns = due;
+}
+
+void UringServer::close_client(int fd) {
+    close(fd);
+    if (Client* client = clients.get(fd)) processor.forget(*client);
+    clients.release(fd);
+}
+
+void UringServer::update_reading(int fd, Client& client) {
+    processor.update_flow(client);
+
+    if (!wants_input(client)) {
+        // A multishot recv cannot be paused, only cancelled. Data already
+        // on its way is still processed; the cancellation posts nothing
+        // unless it fails.
+        if (!client.recv_armed || client.recv_cancelled || client.closing) return;
+        io_uring_sqe* sqe = ring.get_sqe();
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->addr = tag(Op::Recv, client.id);
+        sqe->flags = IOSQE_CQE_SKIP_SUCCESS;
+        client.recv_cancelled = true;
+    } else if (!client.recv_armed) {
+        arm_recv(fd, client);
+    }
+}
+
+void UringServer::abort_client(int fd, Client& client) {
+    // shutdown() terminates the outstanding recv; the fd itself is only
+    // closed once its completion has been seen, so it cannot be reused
+    // while the kernel still refers to it.
+    if (!client.aborted) {
+        client.aborted = true;
+        shutdown(fd, SHUT_RDWR);
+    }
+    if (!client.recv_armed && !client.send_inflight) close_client(fd);
+}
+
+void UringServer::flush_output(int fd, Client& client) {
+    if (client.aborted) {
+        abort_client(fd, client);
+        return;
+    }
+    if (client.send_inflight) {
+        update_reading(fd, client);
+        return;
+    }
+
+    if (!client.out_buf.empty()) {
+        client.msg = msghdr{};
+        client.msg.msg_iov = client.iov;
+        client.msg.msg_iovlen = client.out_buf.fill_iovec(client.iov, kMaxIovecs);
+
+        io_uring_sqe* sqe = ring.get_sqe();
+        sqe->opcode = IORING_OP_SENDMSG;
+        sqe->fd = fd;
+        sqe->addr = reinterpret_cast<uint64_t>(&client.msg);
+        sqe->msg_flags = MSG_NOSIGNAL;
+        sqe->user_data = tag(Op::Send, client.id);
+        client.send_inflight = true;
+        update_reading(fd, client);
+        return;
+    }
+
+    if (client.finished()) {
+        processor.log(client, LogLevel::Info, "Closing", "Finished sending, closing socket");
+        if (client.recv_armed) {
+            abort_client(fd, client);
+        } else {
+            close_client(fd);
+        }
+        return;
+    }
+    update_reading(fd, client);
+}
+
+void UringServer::handle_accept(const io_uring_cqe& cqe) {
+    if (!(cqe.flags & IORING_CQE_F_MORE)) arm_accept();
+    if (cqe.res < 0) {
+        log_errno("accept", -cqe.res);
+        return;
+    }
+
+    int fd = cqe.res;
+    sockaddr_in addr{};
+    socklen_t len = sizeof(addr);
+    getpeername(fd, (sockaddr*)&addr, &len);
+
+    uint64_t id = clients.open(fd);
+    Client& client = *clients.get(fd);
+    processor.on_connected(client, id, addr);
+    arm_recv(fd, client);
+}
+
+void UringServer::handle_recv(int fd, Client& client, const io_uring_cqe& cqe) {
+    bool more = cqe.flags & IORING_CQE_F_MORE;
+    if (!more) client.recv_armed = false;
+
+    if (cqe.res > 0) {
+        uint16_t bid = static_cast<uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+        if (!client.aborted && !client.closing) {
+            // One copy into the connection buffer returns the provided
+            // buffer to the kernel straight away.
+            char* buf = client.in_buf.prepare(cqe.res);
+            std::memcpy(buf, buffers.buffer(bid), cqe.res);
+            client.in_buf.commit(cqe.res);
+            processor.on_received(client, cqe.res, loop_started);
+            processor.log(client, LogLevel::Debug, "Received", std::string_view(buf, cqe.res));
+            // A connection in the ready queue catches up on its own turn.
+            if (!client.ready_queued) serve_input(client);
+        }
+        buffers.recycle(bid);
+        // The kernel may end a multishot recv early (e.g. on CQ overflow).
+        if (!more && wants_input(client)) arm_recv(fd, client);
+    } else if (cqe.res == 0) {
+        if (!client.aborted) processor.on_peer_closed(client);
+    } else if (cqe.res == -ECANCELED) {
+        // Cancelled for backpressure; reading may have resumed since.
+        if (wants_input(client)) arm_recv(fd, client);
+    } else if (cqe.res == -ENOBUFS) {
+        // Every provided buffer was in use; the ones already handled are
+        // queued for return ahead of the new recv.
+        if (!more && wants_input(client)) arm_recv(fd, client);
+    } else if (!client.aborted) {
+        log_errno("recv", -cqe.res);
+        processor.log(client, LogLevel::Info, "Disconnected", "Error or hangup");
+        abort_client(fd, client);
+        return;
+    }
+
+    flush_output(fd, client);
+}
+
+void UringServer::serve_input(Client& client) {
+    processor.start_turn(client);
+    processor.on_input(client);
+    if (client.input_deferred) processor.defer(client);
+}
+
+void UringServer::handle_send(int fd, Client& client, const io_uring_cqe& cqe) {
+    client.send_inflight = false;
+
+    if (cqe.res > 0) {
+        if (processor.log_enabled(LogLevel::Debug))
+            processor.log(client, LogLevel::Debug, "Sent", client.out_buf.peek(cqe.res));
+        client.out_buf.consume(cqe.res);
+        processor.on_sent(client, cqe.res);
+    } else if (!client.aborted) {
+        log_errno("sendmsg", -cqe.res);
+        abort_client(fd, client);
+        return;
+    }
+
+    flush_output(fd, client);
+}
+
+void UringServer::handle_completion(const io_uring_cqe& cqe) {
+    Op op = static_cast<Op>(cqe.user_data >> 56);
+    switch (op) {
+        case Op::Accept:
+            handle_accept(cqe);
+            return;
+        case Op::Completions:
+            if (!(cqe.flags & IORING_CQE_F_MORE)) arm_completions();
+            processor.drain_completions(
+                [this](uint64_t id) -> Connection* { return clients.find(id); },
+                [this](Connection& conn) {
+                    flush_output(ConnectionTable<Client>::fd_of(conn.id), static_cast<Client&>(conn));
+                });
+            return;
+        case Op::Timer:
+            // The only timeout in flight has expired (-ETIME); updates
+            // complete under their own user_data.
+            timer_armed_ns = 0;
+            return;
+        case Op::Recv:
+        case Op::Send:
+            break;
+        default:
+            // A failed buffer provisioning, recv cancellation or timer
+            // update; successful ones post nothing.
+            return;
+    }
+
+    // Connections are only released once nothing is in flight for them,
+    // so a completion never outlives its connection.
+    Client* client = lookup(cqe.user_data);
+    if (!client) return;
+
+    int fd = ConnectionTable<Client>::fd_of(cqe.user_data);
+    if (op == Op::Recv) {
+        handle_recv(fd, *client, cqe);
+    } else {
+        handle_send(fd, *client, cqe);
+    }
+}
+
+void UringServer::run() {
+    while (true) {
+        // Connections in the ready queue have input waiting already.
+        int ret = ring.submit_and_wait(processor.has_ready() ? 0 : 1);
+        if (ret < 0 && ret != -EINTR && ret != -EBUSY) {
+            log_errno("io_uring_enter", -ret);
+            break;
+        }
+        loop_started = monotonic_ns();
+        processor.expire_timers(loop_started, [this](Connection& conn) {
+            abort_client(ConnectionTable<Client>::fd_of(conn.id), static_cast<Client&>(conn));
+        });
+        ring.for_each_completion([this](const io_uring_cqe& cqe) { handle_completion(cqe); });
+        processor.run_ready([this](uint64_t id) -> Connection* { return clients.find(id); },
+                            [this](Connection& conn) {
+                                Client& client = static_cast<Client&>(conn);
+                                if (client.aborted || client.closing || client.read_paused) return;
+                                serve_input(client);
+                                flush_output(ConnectionTable<Client>::fd_of(conn.id), client);
+                            });
+        arm_timer();
+        processor.finish_iteration(loop_started);
+    }
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstdint>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include "Connection.h"
+#include "ConnectionTable.h"
+#include "IReactor.h"
+#include "IoUring.h"
+#include "RequestProcessor.h"
+#include "ServerOptions.h"
+
+// Completion-based reactor on io_uring. The listener runs one multishot
+// accept, every connection one multishot recv that draws from a shared
+// pool of provided buffers, and at most one sendmsg per connection is in
+// flight. Framing, evaluation and response ordering are shared with the
+// epoll reactor through RequestProcessor.
+class UringServer : public IReactor {
+public:
+    explicit UringServer(const ServerOptions& options);
+    ~UringServer() override;
+
+    void run() override;
+
+    const ResultCache::Stats& cache_stats() const { return processor.cache_stats(); }
+
+private:
+    static constexpr size_t kMaxIovecs = 8;
+
+    enum class Op : uint8_t { Accept = 1, Recv, Send, Completions, Timer };
+
+    struct Client : Connection {
+        bool recv_armed = false;
+        // An ASYNC_CANCEL for the armed recv has been submitted.
+        bool recv_cancelled = false;
+        bool send_inflight = false;
+        // Shut down after an error; the fd is closed once no operation
+        // still refers to it.
+        bool aborted = false;
+        iovec iov[kMaxIovecs];
+        msghdr msg{};
+    };
+
+    int server_fd = -1;
+    IoUring ring;
+    BufferPool buffers;
+    // Outlives clients, whose buffers go back to its pool.
+    RequestProcessor processor;
+    ConnectionTable<Client> clients;
+    // Deferred input a connection may buffer before its recv is cancelled.
+    size_t read_budget;
+    // When the current batch of completions was reaped.
+    uint64_t loop_started = 0;
+    // Deadline of the IORING_OP_TIMEOUT that wakes the loop for the
+    // connection timeouts, 0 if none is pending.
+    uint64_t timer_armed_ns = 0;
+    __kernel_timespec timer_spec{};
+
+    // user_data carries the operation in the top byte and the low 56 bits
+    // of the connection id (fd plus 24 bits of generation).
+    static uint64_t tag(Op op, uint64_t id) { return (static_cast<uint64_t>(op) << 56) | (id & kIdMask); }
+    static constexpr uint64_t kIdMask = (uint64_t{1} << 56) - 1;
+    Client* lookup(uint64_t user_data);
+
+    void arm_accept();
+    void arm_recv(int fd, Client& client);
+    bool wants_input(const Client& client) const;
+    void arm_completions();
+    void arm_timer();
+
+    void handle_completion(const io_uring_cqe& cqe);
+    void handle_accept(const io_uring_cqe& cqe);
+    void handle_recv(int fd, Client& client, const io_uring_cqe& cqe);
+    void handle_send(int fd, Client& client, const io_uring_cqe& cqe);
+    // One turn's worth of the requests buffered for client.
+    void serve_input(Client& client);
+
+    void flush_output(int fd, Client& client);
+    void update_reading(int fd, Client& client);
+    void abort_client(int fd, Client& client);
+    void close_client(int fd);
+};
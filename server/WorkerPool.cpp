@@ -0,0 +1,89 @@
+#include "WorkerPool.h"
+
+#include <stdexcept>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include "Format.h"
+#include "ICalc.h"
+
+namespace {
+
+void signal_eventfd(int fd) {
+    uint64_t one = 1;
+    ssize_t n = write(fd, &one, sizeof(one));
+    (void)n;
+}
+
+}
+
+CompletionQueue::CompletionQueue() {
+    event_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (event_fd_ < 0) throw std::runtime_error("Failed to create completion eventfd");
+}
+
+CompletionQueue::~CompletionQueue() {
+    while (OffloadJob* job = queue_.pop()) delete job;
+    close(event_fd_);
+}
+
+void CompletionQueue::push(OffloadJob* job) {
+    queue_.push(job);
+    signal_eventfd(event_fd_);
+}
+
+void CompletionQueue::clear_signal() {
+    uint64_t value;
+    ssize_t n = read(event_fd_, &value, sizeof(value));
+    (void)n;
+}
+
+WorkerPool::WorkerPool(size_t threads, bool exact) : exact_(exact) {
+    for (size_t i = 0; i < threads; ++i) {
+        auto worker = std::make_unique<Worker>();
+        worker->event_fd = eventfd(0, EFD_CLOEXEC);
+        if (worker->event_fd < 0) throw std::runtime_error("Failed to create worker eventfd");
+        workers_.push_back(std::move(worker));
+    }
+    for (auto& worker : workers_) {
+        worker->thread = std::thread([this, w = worker.get()] { worker_loop(*w); });
+    }
+}
+
+WorkerPool::~WorkerPool() {
+    stop_.store(true, std::memory_order_release);
+    for (auto& worker : workers_) signal_eventfd(worker->event_fd);
+    for (auto& worker : workers_) {
+        worker->thread.join();
+        while (OffloadJob* job = worker->inbox.pop()) delete job;
+        close(worker->event_fd);
+    }
+}
+
+void WorkerPool::submit(OffloadJob* job) {
+    Worker& worker = *workers_[next_.fetch_add(1, std::memory_order_relaxed) % workers_.size()];
+    worker.inbox.push(job);
+    signal_eventfd(worker.event_fd);
+}
+
+void WorkerPool::worker_loop(Worker& worker) {
+    CalcImpl calc(exact_);
+    char line[kMaxBinaryResponse];
+
+    while (!stop_.load(std::memory_order_acquire)) {
+        uint64_t value;
+        if (read(worker.event_fd, &value, sizeof(value)) < 0) continue;
+
+        while (OffloadJob* job = worker.inbox.pop()) {
+            if (stop_.load(std::memory_order_acquire)) {
+                delete job;
+                continue;
+            }
+            job->result = calc.try_calculate(job->expr);
+            size_t len = job->binary ? format_binary_response(job->request_id, job->result, job->flags, line)
+                                     : format_response(job->result, line);
+            job->response.assign(line, len);
+            job->reply_to->push(job);
+        }
+    }
+}
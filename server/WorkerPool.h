@@ -0,0 +1,83 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "CalcResult.h"
+#include "MpscQueue.h"
+
+class CompletionQueue;
+
+// An expression handed off to the worker pool. The reactor fills in the
+// input fields; the worker evaluates it, renders the response (a text line,
+// or a frame when binary is set) and sends the job back through reply_to.
+struct OffloadJob : MpscNode {
+    std::string expr;
+    uint64_t conn_id = 0;
+    uint64_t seq = 0;
+    CompletionQueue* reply_to = nullptr;
+
+    bool binary = false;
+    uint32_t request_id = 0;
+    uint8_t flags = 0;
+
+    CalcResult result;
+    std::string response;
+};
+
+// Per-reactor inbox for finished jobs. Workers push and bump an eventfd
+// that the reactor watches in its epoll set.
+class CompletionQueue {
+public:
+    CompletionQueue();
+    ~CompletionQueue();
+
+    CompletionQueue(const CompletionQueue&) = delete;
+    CompletionQueue& operator=(const CompletionQueue&) = delete;
+
+    int fd() const { return event_fd_; }
+
+    void push(OffloadJob* job);
+
+    // Reactor side: clears the eventfd, then pops until nullptr.
+    void clear_signal();
+    OffloadJob* pop() { return queue_.pop(); }
+
+private:
+    MpscQueue<OffloadJob> queue_;
+    int event_fd_ = -1;
+};
+
+// Fixed set of evaluation threads shared by all reactors. Jobs are spread
+// round-robin over per-worker lock-free inboxes; an idle worker sleeps in
+// read() on its eventfd. exact selects the calculator's exact mode.
+class WorkerPool {
+public:
+    explicit WorkerPool(size_t threads, bool exact = false);
+    ~WorkerPool();
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    size_t size() const { return workers_.size(); }
+
+    void submit(OffloadJob* job);
+
+private:
+    struct Worker {
+        MpscQueue<OffloadJob> inbox;
+        int event_fd = -1;
+        std::thread thread;
+    };
+
+    void worker_loop(Worker& worker);
+
+    bool exact_;
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::atomic<size_t> next_{0};
+    std::atomic<bool> stop_{false};
+};
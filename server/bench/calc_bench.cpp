@@ -0,0 +1,357 @@
+// Micro-benchmarks for the calculator, response formatting and input
+// framing. Prints a line per case to stderr and the results as JSON, one
+// case per line, so that two runs can be compared with diff.
+//
+//   calc_bench [--min-time SEC] [--filter TEXT] [--json FILE]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <new>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "../CharScan.h"
+#include "../Format.h"
+#include "../ICalc.h"
+#include "../InputBuffer.h"
+
+// Every heap allocation in the process goes through here, so a case can
+// report how many it makes per operation.
+static uint64_t g_allocations = 0;
+
+void* operator new(size_t size) {
+    ++g_allocations;
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+
+namespace {
+
+struct Options {
+    double min_time = 0.2;
+    std::string filter;
+    std::string json_path;
+};
+
+struct Result {
+    std::string name;
+    std::string isa;
+    uint64_t ops = 0;
+    double ns_per_op = 0.0;
+    double allocs_per_op = 0.0;
+    double mb_per_s = 0.0;
+};
+
+template <typename T>
+void do_not_optimize(const T& value) {
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+uint64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+// Deterministic expression of operands numbers in 1..999 joined by random
+// operators, without spaces, like the ones the client sends.
+std::string make_expression(size_t operands, std::mt19937& rng) {
+    std::uniform_int_distribution<int> number(1, 999);
+    std::uniform_int_distribution<int> op(0, 3);
+    std::string expr;
+    expr.reserve(operands * 4);
+    for (size_t i = 0; i < operands; ++i) {
+        if (i > 0) expr += "+-*/"[op(rng)];
+        expr += std::to_string(number(rng));
+    }
+    return expr;
+}
+
+class Bench {
+public:
+    explicit Bench(const Options& options) : options_(options) {}
+
+    bool wanted(const std::string& name) const {
+        return options_.filter.empty() || name.find(options_.filter) != std::string::npos;
+    }
+
+    // Calls body, which performs ops_per_call operations over bytes_per_call
+    // input bytes, in doubling batches until min_time has been spent.
+    template <typename Fn>
+    void run(const std::string& name, uint64_t ops_per_call, size_t bytes_per_call, Fn&& body) {
+        if (!wanted(name)) return;
+        body();
+
+        uint64_t calls = 0, elapsed = 0, allocations = 0;
+        const uint64_t budget = static_cast<uint64_t>(options_.min_time * 1e9);
+        for (uint64_t batch = 1; elapsed < budget; batch = std::min<uint64_t>(batch * 2, 1u << 20)) {
+            uint64_t allocs_before = g_allocations;
+            uint64_t start = now_ns();
+            for (uint64_t i = 0; i < batch; ++i) body();
+            elapsed += now_ns() - start;
+            allocations += g_allocations - allocs_before;
+            calls += batch;
+        }
+
+        Result r;
+        r.name = name;
+        r.isa = charscan::isa_name(charscan::active_isa());
+        r.ops = calls * ops_per_call;
+        r.ns_per_op = static_cast<double>(elapsed) / r.ops;
+        r.allocs_per_op = static_cast<double>(allocations) / r.ops;
+        r.mb_per_s = bytes_per_call * calls / (elapsed / 1e9) / 1e6;
+        std::fprintf(stderr, "%-28s %-7s %12.1f ns/op %8.2f allocs/op %10.1f MB/s\n", r.name.c_str(),
+                     r.isa.c_str(), r.ns_per_op, r.allocs_per_op, r.mb_per_s);
+        results_.push_back(std::move(r));
+    }
+
+    std::string json() const {
+        char line[512];
+        std::string out = "{\"default_isa\":\"";
+        out += charscan::isa_name(default_isa_);
+        out += "\",\"results\":[\n";
+        for (size_t i = 0; i < results_.size(); ++i) {
+            const Result& r = results_[i];
+            std::snprintf(line, sizeof(line),
+                          "{\"name\":\"%s\",\"isa\":\"%s\",\"ops\":%llu,\"ns_per_op\":%.2f,"
+                          "\"allocs_per_op\":%.4f,\"mb_per_s\":%.1f}%s\n",
+                          r.name.c_str(), r.isa.c_str(), static_cast<unsigned long long>(r.ops), r.ns_per_op,
+                          r.allocs_per_op, r.mb_per_s, i + 1 < results_.size() ? "," : "");
+            out += line;
+        }
+        out += "]}\n";
+        return out;
+    }
+
+    charscan::Isa default_isa() const { return default_isa_; }
+
+private:
+    Options options_;
+    charscan::Isa default_isa_ = charscan::active_isa();
+    std::vector<Result> results_;
+};
+
+// Narrowest first, ending on the widest the CPU supports.
+std::vector<charscan::Isa> supported_isas(charscan::Isa widest) {
+    std::vector<charscan::Isa> isas;
+    for (charscan::Isa isa : {charscan::Isa::Scalar, charscan::Isa::Sse2, charscan::Isa::Avx2}) {
+        if (charscan::select_isa(isa)) isas.push_back(isa);
+    }
+    charscan::select_isa(widest);
+    return isas;
+}
+
+void bench_calc(Bench& bench, const std::vector<charscan::Isa>& isas) {
+    std::mt19937 rng(42);
+    CalcImpl calc;
+    for (size_t operands : {size_t{5}, size_t{100}, size_t{10000}, size_t{1000000}}) {
+        std::string expr = make_expression(operands, rng);
+        if (!calc.try_calculate(expr)) throw std::logic_error("benchmark expression does not evaluate");
+        for (charscan::Isa isa : isas) {
+            charscan::select_isa(isa);
+            bench.run("calc/" + std::to_string(operands), 1, expr.size(),
+                      [&] { do_not_optimize(calc.try_calculate(expr)); });
+        }
+    }
+    charscan::select_isa(bench.default_isa());
+}
+
+// The exact engine on the same kind of input. Long expressions with
+// divisions outgrow int64 rationals and fall back to double, which shows up
+// as the cost of both evaluations.
+void bench_exact(Bench& bench) {
+    std::mt19937 rng(42);
+    CalcImpl calc(true);
+    for (size_t operands : {size_t{5}, size_t{100}}) {
+        std::string expr = make_expression(operands, rng);
+        if (!calc.try_calculate(expr)) throw std::logic_error("benchmark expression does not evaluate");
+        bench.run("calc_exact/" + std::to_string(operands), 1, expr.size(),
+                  [&] { do_not_optimize(calc.try_calculate(expr)); });
+    }
+
+    std::vector<Rational> values(1024);
+    std::uniform_int_distribution<int64_t> num(-100000000, 100000000);
+    std::uniform_int_distribution<int64_t> den(1, 1000);
+    for (Rational& v : values) {
+        v.num = num(rng);
+        v.den = den(rng);
+    }
+    char buf[Rational::kMaxFormatted];
+    size_t bytes = 0;
+    for (const Rational& v : values) bytes += v.format_2dp(buf);
+    bench.run("format_rational_2dp", values.size(), bytes, [&] {
+        for (const Rational& v : values) {
+            do_not_optimize(v.format_2dp(buf));
+            do_not_optimize(buf[0]);
+        }
+    });
+}
+
+// A request's worth of short expressions through the ICalc interface, one
+// call each and then as one batch.
+void bench_dispatch(Bench& bench) {
+    std::mt19937 rng(5);
+    std::vector<std::string> storage;
+    for (int i = 0; i < 32; ++i) storage.push_back(make_expression(5, rng));
+    std::vector<std::string_view> exprs(storage.begin(), storage.end());
+    std::vector<CalcResult> results(exprs.size());
+    size_t bytes = 0;
+    for (std::string_view e : exprs) bytes += e.size();
+
+    CalcImpl impl;
+    // Through a pointer the compiler cannot see through, like a caller
+    // that only knows the interface.
+    ICalc* volatile hidden = &impl;
+    ICalc& calc = *hidden;
+    bench.run("dispatch/single", exprs.size(), bytes, [&] {
+        for (size_t i = 0; i < exprs.size(); ++i) results[i] = calc.try_calculate(exprs[i]);
+        do_not_optimize(results.back().value);
+    });
+    bench.run("dispatch/batch", exprs.size(), bytes, [&] {
+        calc.try_calculate_batch(exprs.data(), exprs.size(), results.data());
+        do_not_optimize(results.back().value);
+    });
+}
+
+void bench_errors(Bench& bench) {
+    std::mt19937 rng(7);
+    std::string valid = make_expression(100, rng);
+    struct Case {
+        const char* name;
+        std::string expr;
+    };
+    // The invalid character is last so the whole input is scanned first.
+    const Case cases[] = {
+        {"error/empty", ""},
+        {"error/invalid_character", valid + "x"},
+        {"error/syntax", valid + "+*2"},
+        {"error/division_by_zero", valid + "/0"},
+    };
+
+    CalcImpl calc;
+    for (const Case& c : cases) {
+        if (calc.try_calculate(c.expr)) throw std::logic_error(std::string(c.name) + " does not fail");
+        bench.run(c.name, 1, c.expr.size(), [&] { do_not_optimize(calc.try_calculate(c.expr)); });
+    }
+
+    // The throwing wrapper, for comparison with the error codes above.
+    const std::string& syntax = cases[2].expr;
+    bench.run("error/syntax_throw", 1, syntax.size(), [&] {
+        try {
+            do_not_optimize(calc.calculate(syntax));
+        } catch (const std::exception& e) {
+            do_not_optimize(e.what());
+        }
+    });
+}
+
+void bench_format(Bench& bench) {
+    std::mt19937 rng(3);
+    std::uniform_real_distribution<double> small(-1000.0, 1000.0);
+    std::uniform_real_distribution<double> large(-1e15, 1e15);
+    std::vector<double> values(1024);
+    for (size_t i = 0; i < values.size(); ++i) values[i] = i % 4 == 3 ? large(rng) : small(rng);
+
+    char buf[kMaxFormattedDouble];
+    size_t bytes = 0;
+    for (double v : values) bytes += format_double_2dp(v, buf);
+
+    bench.run("format_double_2dp", values.size(), bytes, [&] {
+        for (double v : values) {
+            do_not_optimize(format_double_2dp(v, buf));
+            do_not_optimize(buf[0]);
+        }
+    });
+}
+
+// The delimiter search and extraction loop of the text protocol, fed as
+// recv() would fill the buffer: in pieces of chunk bytes.
+void bench_framing(Bench& bench, const std::vector<charscan::Isa>& isas) {
+    std::mt19937 rng(11);
+    std::string stream;
+    uint64_t frames = 0;
+    while (stream.size() < (1u << 20)) {
+        stream += make_expression(5, rng);
+        stream += ' ';
+        ++frames;
+    }
+
+    InputBuffer in;
+    for (size_t chunk : {size_t{16}, size_t{4096}}) {
+        for (charscan::Isa isa : isas) {
+            charscan::select_isa(isa);
+            bench.run("framing/chunk" + std::to_string(chunk), frames, stream.size(), [&] {
+                std::string_view frame;
+                for (size_t pos = 0; pos < stream.size(); pos += chunk) {
+                    size_t n = std::min(chunk, stream.size() - pos);
+                    std::memcpy(in.prepare(n), stream.data() + pos, n);
+                    in.commit(n);
+                    while (in.next_frame(' ', frame)) do_not_optimize(frame.size());
+                }
+            });
+        }
+    }
+    charscan::select_isa(bench.default_isa());
+}
+
+void usage(const char* prog) {
+    std::cerr << "Usage: " << prog << " [--min-time SEC] [--filter TEXT] [--json FILE]\n";
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        if (i + 1 >= argc) {
+            usage(argv[0]);
+            return 1;
+        }
+        if (std::strcmp(argv[i], "--min-time") == 0) {
+            options.min_time = std::atof(argv[++i]);
+        } else if (std::strcmp(argv[i], "--filter") == 0) {
+            options.filter = argv[++i];
+        } else if (std::strcmp(argv[i], "--json") == 0) {
+            options.json_path = argv[++i];
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (options.min_time <= 0) {
+        std::cerr << "Invalid --min-time\n";
+        return 1;
+    }
+
+    try {
+        Bench bench(options);
+        std::vector<charscan::Isa> isas = supported_isas(bench.default_isa());
+        bench_calc(bench, isas);
+        bench_exact(bench);
+        bench_dispatch(bench);
+        bench_errors(bench);
+        bench_format(bench);
+        bench_framing(bench, isas);
+
+        if (options.json_path.empty()) {
+            std::cout << bench.json();
+        } else {
+            std::ofstream file(options.json_path);
+            if (!file) throw std::runtime_error("Failed to open " + options.json_path);
+            file << bench.json();
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Fatal error: " << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
@@ -1,17 +1,202 @@
+#include <algorithm>
+#include <cstring>
 #include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
 
+#include "AdminServer.h"
+#include "Logger.h"
 #include "server.h"
+#ifdef HAVE_IO_URING
+#include "UringServer.h"
+#endif
+
+static void usage(const char* prog) {
+    std::cerr << "Usage: " << prog << " <port> [--threads N] [--log-level debug|info|warn|error|off]"
+              << " [--cache-mb MB] [--workers N] [--offload-bytes N] [--backend epoll|uring]"
+              << " [--high-watermark BYTES] [--low-watermark BYTES] [--max-expression BYTES]"
+              << " [--streaming on|off] [--admin-port PORT]"
+              << " [--idle-timeout SEC] [--header-timeout SEC] [--write-timeout SEC]"
+              << " [--read-budget BYTES] [--expression-budget N] [--exact on|off]\n";
+}
+
+// Seconds (fractions allowed) to milliseconds; 0 disables the timeout.
+static bool parse_timeout(const char* text, uint64_t& ms) {
+    double seconds = std::stod(text);
+    if (!(seconds >= 0)) return false;
+    ms = static_cast<uint64_t>(seconds * 1000);
+    return true;
+}
 
 int main(int argc, char* argv[]) {
-    if (argc != 2) {
-        std::cerr << "Usage: " << argv[0] << " <port>\n";
+    if (argc < 2) {
+        usage(argv[0]);
         return 1;
     }
 
     try {
-        int port = std::stoi(argv[1]);
-        Server server(port);
-        server.run();
+        ServerOptions options;
+        options.port = std::stoi(argv[1]);
+        int threads = 1;
+        size_t cache_mb = 0;
+        int worker_threads = 2;
+        int admin_port = 0;
+        LogLevel log_level = LogLevel::Info;
+
+        for (int i = 2; i < argc; ++i) {
+            if (i + 1 >= argc) {
+                usage(argv[0]);
+                return 1;
+            }
+            if (std::strcmp(argv[i], "--threads") == 0) {
+                threads = std::stoi(argv[++i]);
+                if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+                if (threads < 0) {
+                    std::cerr << "Invalid number of threads\n";
+                    return 1;
+                }
+            } else if (std::strcmp(argv[i], "--log-level") == 0) {
+                if (!parse_log_level(argv[++i], log_level)) {
+                    std::cerr << "Invalid log level: " << argv[i] << "\n";
+                    return 1;
+                }
+            } else if (std::strcmp(argv[i], "--cache-mb") == 0) {
+                cache_mb = std::stoul(argv[++i]);
+            } else if (std::strcmp(argv[i], "--workers") == 0) {
+                worker_threads = std::stoi(argv[++i]);
+                if (worker_threads < 0) {
+                    std::cerr << "Invalid number of workers\n";
+                    return 1;
+                }
+            } else if (std::strcmp(argv[i], "--offload-bytes") == 0) {
+                options.offload_bytes = std::stoul(argv[++i]);
+            } else if (std::strcmp(argv[i], "--high-watermark") == 0) {
+                options.output_high_watermark = std::stoul(argv[++i]);
+            } else if (std::strcmp(argv[i], "--low-watermark") == 0) {
+                options.output_low_watermark = std::stoul(argv[++i]);
+            } else if (std::strcmp(argv[i], "--max-expression") == 0) {
+                options.max_expression_bytes = std::stoul(argv[++i]);
+                if (options.max_expression_bytes == 0) {
+                    std::cerr << "Invalid maximum expression size\n";
+                    return 1;
+                }
+            } else if (std::strcmp(argv[i], "--streaming") == 0) {
+                ++i;
+                if (std::strcmp(argv[i], "on") == 0) {
+                    options.streaming = true;
+                } else if (std::strcmp(argv[i], "off") == 0) {
+                    options.streaming = false;
+                } else {
+                    std::cerr << "Invalid streaming mode: " << argv[i] << "\n";
+                    return 1;
+                }
+            } else if (std::strcmp(argv[i], "--exact") == 0) {
+                ++i;
+                if (std::strcmp(argv[i], "on") == 0) {
+                    options.exact = true;
+                } else if (std::strcmp(argv[i], "off") == 0) {
+                    options.exact = false;
+                } else {
+                    std::cerr << "Invalid exact mode: " << argv[i] << "\n";
+                    return 1;
+                }
+            } else if (std::strcmp(argv[i], "--idle-timeout") == 0) {
+                if (!parse_timeout(argv[++i], options.idle_timeout_ms)) {
+                    std::cerr << "Invalid idle timeout\n";
+                    return 1;
+                }
+            } else if (std::strcmp(argv[i], "--header-timeout") == 0) {
+                if (!parse_timeout(argv[++i], options.header_timeout_ms)) {
+                    std::cerr << "Invalid header timeout\n";
+                    return 1;
+                }
+            } else if (std::strcmp(argv[i], "--write-timeout") == 0) {
+                if (!parse_timeout(argv[++i], options.write_timeout_ms)) {
+                    std::cerr << "Invalid write timeout\n";
+                    return 1;
+                }
+            } else if (std::strcmp(argv[i], "--read-budget") == 0) {
+                options.read_budget_bytes = std::stoul(argv[++i]);
+            } else if (std::strcmp(argv[i], "--expression-budget") == 0) {
+                options.expression_budget = std::stoul(argv[++i]);
+            } else if (std::strcmp(argv[i], "--admin-port") == 0) {
+                admin_port = std::stoi(argv[++i]);
+                if (admin_port < 0 || admin_port > 65535) {
+                    std::cerr << "Invalid admin port\n";
+                    return 1;
+                }
+            } else if (std::strcmp(argv[i], "--backend") == 0) {
+                ++i;
+                if (std::strcmp(argv[i], "epoll") == 0) {
+                    options.backend = Backend::Epoll;
+                } else if (std::strcmp(argv[i], "uring") == 0) {
+#ifdef HAVE_IO_URING
+                    options.backend = Backend::Uring;
+#else
+                    std::cerr << "This build has no io_uring support\n";
+                    return 1;
+#endif
+                } else {
+                    std::cerr << "Invalid backend: " << argv[i] << "\n";
+                    return 1;
+                }
+            } else {
+                std::cerr << "Unknown option: " << argv[i] << "\n";
+                usage(argv[0]);
+                return 1;
+            }
+        }
+
+        if (options.output_low_watermark > options.output_high_watermark) {
+            std::cerr << "Low watermark must not exceed the high watermark\n";
+            return 1;
+        }
+
+        Logger::instance().set_level(log_level);
+
+        // Each reactor owns its listening socket; with SO_REUSEPORT the kernel
+        // spreads incoming connections across them. The cache budget is split
+        // between the per-reactor caches.
+        options.reuse_port = threads > 1;
+        options.cache_bytes = cache_mb * 1024 * 1024 / threads;
+
+        // Declared after the reactors so it is torn down first: no worker
+        // can then push into a destroyed completion queue.
+        std::vector<std::unique_ptr<IReactor>> reactors;
+        std::unique_ptr<WorkerPool> pool;
+        if (worker_threads > 0) {
+            pool = std::make_unique<WorkerPool>(worker_threads, options.exact);
+            options.workers = pool.get();
+        }
+
+        for (int i = 0; i < threads; ++i) {
+#ifdef HAVE_IO_URING
+            if (options.backend == Backend::Uring) {
+                reactors.push_back(std::make_unique<UringServer>(options));
+                continue;
+            }
+#endif
+            reactors.push_back(std::make_unique<Server>(options));
+        }
+
+        std::unique_ptr<AdminServer> admin;
+        if (admin_port > 0) admin = std::make_unique<AdminServer>(admin_port);
+
+        std::vector<std::thread> workers;
+        for (int i = 1; i < threads; ++i) {
+            workers.emplace_back([&server = *reactors[i]] {
+                try {
+                    server.run();
+                } catch (const std::exception& e) {
+                    std::cerr << "Reactor error: " << e.what() << "\n";
+                }
+            });
+        }
+
+        reactors[0]->run();
+
+        for (auto& t : workers) t.join();
     } catch (const std::exception& e) {
         std::cerr << "Fatal error: " << e.what() << "\n";
         return 1;
@@ -1,82 +1,65 @@
 #include "server.h"
+#include "Socket.h"
 
+#include <algorithm>
+#include <cstdint>
 #include <iostream>
-#include <iomanip>
 #include <unistd.h>
-#include <fcntl.h>
 #include <sys/socket.h>
-#include <arpa/inet.h>
-#include <chrono>
 
 
 constexpr int MAX_EVENTS = 64;
 constexpr int BUFFER_SIZE = 4096;
+constexpr int MAX_IOVECS = 64;
+constexpr uint64_t LISTENER_ID = ~uint64_t{0};
+constexpr uint64_t COMPLETIONS_ID = LISTENER_ID - 1;
 
-Server::Server(int port) {
-    server_fd = socket(AF_INET, SOCK_STREAM, 0);
-    if (server_fd < 0) throw std::runtime_error("Failed to create socket");
-
-    set_nonblocking(server_fd);
-    int opt = 1;
-    setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
-
-    sockaddr_in addr{};
-    addr.sin_family = AF_INET;
-    addr.sin_addr.s_addr = INADDR_ANY;
-    addr.sin_port = htons(port);
-
-    if (bind(server_fd, (sockaddr*)&addr, sizeof(addr)) < 0)
-        throw std::runtime_error("Failed to bind socket");
-
-    if (listen(server_fd, SOMAXCONN) < 0)
-        throw std::runtime_error("Failed to listen on socket");
+Server::Server(const ServerOptions& options)
+    : processor(options), read_budget(options.read_budget_bytes ? options.read_budget_bytes : SIZE_MAX) {
+    server_fd = create_listener(options.port, options.reuse_port, true);
 
     epoll_fd = epoll_create1(0);
     epoll_event ev{};
     ev.events = EPOLLIN | EPOLLET;
-    ev.data.fd = server_fd;
+    ev.data.u64 = LISTENER_ID;
     epoll_ctl(epoll_fd, EPOLL_CTL_ADD, server_fd, &ev);
 
-    std::cout << "Server listening on port " << port << "...\n";
+    if (processor.completion_fd() != -1) {
+        epoll_event cev{};
+        cev.events = EPOLLIN | EPOLLET;
+        cev.data.u64 = COMPLETIONS_ID;
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, processor.completion_fd(), &cev);
+    }
+
+    std::cout << "Server listening on port " << options.port << "...\n";
 }
 
 Server::~Server() {
-    for (auto& [fd, _] : clients) close(fd);
+    clients.for_each([](int fd, Client&) { close(fd); });
     if (server_fd != -1) close(server_fd);
     if (epoll_fd != -1) close(epoll_fd);
 }
 
-int Server::set_nonblocking(int fd) {
-    int flags = fcntl(fd, F_GETFL, 0);
-    return (flags == -1) ? -1 : fcntl(fd, F_SETFL, flags | O_NONBLOCK);
-}
-
-std::string Server::current_timestamp() {
-    auto now = std::chrono::system_clock::now();
-    std::time_t tt = std::chrono::system_clock::to_time_t(now);
-    std::tm tm{};
-    localtime_r(&tt, &tm);
-    std::ostringstream oss;
-    oss << std::put_time(&tm, "[%Y-%m-%d %H:%M:%S]");
-    return oss.str();
+void Server::handle_completions() {
+    processor.drain_completions(
+        [this](uint64_t id) -> Connection* { return clients.find(id); },
+        [this](Connection& conn) { flush_output(ConnectionTable<Client>::fd_of(conn.id), static_cast<Client&>(conn)); });
 }
 
-void Server::log_message(const sockaddr_in& addr, const std::string& prefix, const std::string& message) {
-    char ip[INET_ADDRSTRLEN];
-    inet_ntop(AF_INET, &(addr.sin_addr), ip, sizeof(ip));
-    uint16_t port = ntohs(addr.sin_port);
-    std::cout << current_timestamp() << " From " << ip << ":" << port << " — " << prefix << ": " << message << "\n";
+void Server::set_events(int client_fd, uint32_t events) {
+    epoll_event ev{};
+    ev.events = events | EPOLLET | EPOLLRDHUP | EPOLLHUP | EPOLLERR;
+    ev.data.u64 = clients.id_of(client_fd);
+    epoll_ctl(epoll_fd, EPOLL_CTL_MOD, client_fd, &ev);
 }
 
-std::string Server::format_double_2dp(double val) {
-    std::ostringstream oss;
-    oss << std::fixed << std::setprecision(2) << val;
-    return oss.str();
+void Server::close_client(int client_fd) {
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, client_fd, nullptr);
+    close(client_fd);
+    if (Client* client = clients.get(client_fd)) processor.forget(*client);
+    clients.release(client_fd);
 }
 
-
-
-
 void Server::handle_new_connection() {
     while (true) {
         sockaddr_in client_addr{};
@@ -92,163 +75,156 @@ void Server::handle_new_connection() {
 
         epoll_event ev{};
         ev.events = EPOLLIN | EPOLLET | EPOLLRDHUP | EPOLLHUP | EPOLLERR;
-        ev.data.fd = client_fd;
+        uint64_t id = clients.open(client_fd);
+        ev.data.u64 = id;
 
         if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, client_fd, &ev) < 0) {
             perror("epoll_ctl ADD client");
+            clients.release(client_fd);
             close(client_fd);
             continue;
         }
 
-        clients[client_fd] = Client{"", "", 0, client_addr, false};
-        log_message(client_addr, "Connected", "New client connected");
+        processor.on_connected(*clients.get(client_fd), id, client_addr);
     }
 }
 
-void Server::handle_client_data(int client_fd, uint32_t events) {
-    auto it = clients.find(client_fd);
-    if (it == clients.end()) return;
+bool Server::flush_output(int client_fd, Client& client) {
+    bool blocked = false;
+    while (!client.out_buf.empty()) {
+        iovec iov[MAX_IOVECS];
+        msghdr msg{};
+        msg.msg_iov = iov;
+        msg.msg_iovlen = client.out_buf.fill_iovec(iov, MAX_IOVECS);
+
+        ssize_t sent = sendmsg(client_fd, &msg, MSG_NOSIGNAL);
+        if (sent > 0) {
+            if (processor.log_enabled(LogLevel::Debug))
+                processor.log(client, LogLevel::Debug, "Sent", client.out_buf.peek(sent));
+            client.out_buf.consume(sent);
+            processor.on_sent(client, sent);
+        } else if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            blocked = true;
+            break;
+        } else {
+            perror("sendmsg");
+            close_client(client_fd);
+            return false;
+        }
+    }
 
-    Client& client = it->second;
+    if (client.finished()) {
+        processor.log(client, LogLevel::Info, "Closing", "Finished sending, closing socket");
+        close_client(client_fd);
+        return false;
+    }
 
-    if (events & (EPOLLERR | EPOLLHUP)) {
-        log_message(client.addr, "Disconnected", "Error or hangup");
-        close(client_fd);
-        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, client_fd, nullptr);
-        clients.erase(it);
-        return;
+    // EPOLLIN is dropped while the output is above the high watermark.
+    // Reading may have stopped short of EAGAIN, so a resume always goes
+    // through EPOLL_CTL_MOD, which re-reports data already waiting.
+    bool flow_changed = processor.update_flow(client);
+    uint32_t wanted = (client.read_paused ? 0 : uint32_t{EPOLLIN}) | (blocked ? uint32_t{EPOLLOUT} : 0);
+    if (wanted != client.events || flow_changed) {
+        client.events = wanted;
+        set_events(client_fd, wanted);
     }
+    return true;
+}
 
-    if (events & EPOLLRDHUP) {
-        log_message(client.addr, "Peer closed", "Received EPOLLRDHUP");
-
-        if (!client.in_buf.empty()) {
-            std::string expr = client.in_buf;
-            client.in_buf.clear();
-            try {
-                double result = calc.calculate(expr);
-                std::string response = format_double_2dp(result) + "\n";
-                client.out_buf += response;
-                log_message(client.addr, "Calculated (last)", expr + " = " + response);
-            } catch (const std::exception& e) {
-                std::string err_msg = std::string("Error: ") + e.what() + "\n";
-                client.out_buf += err_msg;
-                log_message(client.addr, "Exception (last)", err_msg);
-            }
-        }
+void Server::handle_client_data(uint64_t id, uint32_t events) {
+    Client* found = clients.find(id);
+    if (!found) return;
 
-        if (client.out_buf.empty()) {
-            close(client_fd);
-            epoll_ctl(epoll_fd, EPOLL_CTL_DEL, client_fd, nullptr);
-            clients.erase(it);
-        } else {
-            client.closing = true;
-            epoll_event ev_mod{};
-            ev_mod.events = EPOLLOUT | EPOLLET | EPOLLRDHUP | EPOLLHUP | EPOLLERR;
-            ev_mod.data.fd = client_fd;
-            epoll_ctl(epoll_fd, EPOLL_CTL_MOD, client_fd, &ev_mod);
-        }
+    Client& client = *found;
+    int client_fd = ConnectionTable<Client>::fd_of(id);
+
+    if (events & (EPOLLERR | EPOLLHUP)) {
+        processor.log(client, LogLevel::Info, "Disconnected", "Error or hangup");
+        close_client(client_fd);
         return;
     }
 
-    if (events & EPOLLIN) {
-        while (true) {
-            char buf[BUFFER_SIZE];
-            ssize_t count = recv(client_fd, buf, sizeof(buf), 0);
+    // Whether the socket was read until EAGAIN or EOF.
+    bool drained = false;
+    bool eof = false;
+    if ((events & EPOLLIN) && !client.closing && !client.read_paused) {
+        processor.start_turn(client);
+        // Requests left over from the previous turn go first.
+        if (client.input_deferred) {
+            processor.on_input(client);
+            processor.update_flow(client);
+        }
+
+        size_t budget = read_budget;
+        while (!client.read_paused && !client.input_deferred && budget > 0) {
+            char* buf = client.in_buf.prepare(BUFFER_SIZE);
+            ssize_t count = recv(client_fd, buf, std::min(client.in_buf.writable(), budget), 0);
             if (count > 0) {
-                client.in_buf.append(buf, count);
-                log_message(client.addr, "Received", std::string(buf, count));
-
-                size_t pos;
-                while ((pos = client.in_buf.find(' ')) != std::string::npos) {
-                    std::string expr = client.in_buf.substr(0, pos);
-                    client.in_buf.erase(0, pos + 1);
-
-                    if (!expr.empty()) {
-                        try {
-                            double result = calc.calculate(expr);
-                            std::string response = format_double_2dp(result) + "\n";
-                            client.out_buf += response;
-                            log_message(client.addr, "Calculated", expr + " = " + response);
-                        } catch (const std::exception& e) {
-                            std::string err_msg = std::string("Error: ") + e.what() + "\n";
-                            client.out_buf += err_msg;
-                            log_message(client.addr, "Exception", err_msg);
-                        }
-                    }
-                }
-
-                if (!client.out_buf.empty()) {
-                    epoll_event ev_mod{};
-                    ev_mod.events = EPOLLOUT | EPOLLET | EPOLLRDHUP | EPOLLHUP | EPOLLERR;
-                    ev_mod.data.fd = client_fd;
-                    epoll_ctl(epoll_fd, EPOLL_CTL_MOD, client_fd, &ev_mod);
-                }
+                budget -= count;
+                client.in_buf.commit(count);
+                processor.on_received(client, count, loop_started);
+                processor.log(client, LogLevel::Debug, "Received", std::string_view(buf, count));
+                processor.on_input(client);
+                processor.update_flow(client);
             } else if (count == 0 || (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                drained = true;
+                eof = count == 0;
                 break;
             } else {
                 perror("recv");
-                close(client_fd);
-                epoll_ctl(epoll_fd, EPOLL_CTL_DEL, client_fd, nullptr);
-                clients.erase(it);
+                close_client(client_fd);
                 return;
             }
         }
+        // Edge-triggered epoll will not report what is left in the socket
+        // again, so the connection waits in the ready queue instead.
+        if (!drained && !client.read_paused) processor.defer(client);
     }
 
-    if (events & EPOLLOUT) {
-        while (client.out_sent < client.out_buf.size()) {
-            ssize_t sent = send(client_fd, client.out_buf.data() + client.out_sent,
-                                client.out_buf.size() - client.out_sent, 0);
-            if (sent > 0) {
-                log_message(client.addr, "Sent", client.out_buf.substr(client.out_sent, sent));
-                client.out_sent += sent;
-            } else if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
-                break;
-            } else {
-                perror("send");
-                close(client_fd);
-                epoll_ctl(epoll_fd, EPOLL_CTL_DEL, client_fd, nullptr);
-                clients.erase(it);
-                return;
-            }
-        }
+    // While reading is paused or cut short by the budget, the socket may
+    // still hold data sent before the FIN; the hangup is handled once it
+    // has been read.
+    if (drained && (eof || (events & EPOLLRDHUP))) processor.on_peer_closed(client);
 
-        if (client.out_sent >= client.out_buf.size()) {
-            client.out_buf.clear();
-            client.out_sent = 0;
+    // Everything produced by this batch of reads goes out in one sendmsg();
+    // EPOLLOUT is only armed if the socket would block.
+    flush_output(client_fd, client);
+}
 
-            if (client.closing) {
-                log_message(client.addr, "Closing", "Finished sending, closing socket");
-                close(client_fd);
-                epoll_ctl(epoll_fd, EPOLL_CTL_DEL, client_fd, nullptr);
-                clients.erase(it);
-            } else {
-                epoll_event ev_mod{};
-                ev_mod.events = EPOLLIN | EPOLLET | EPOLLRDHUP | EPOLLHUP | EPOLLERR;
-                ev_mod.data.fd = client_fd;
-                epoll_ctl(epoll_fd, EPOLL_CTL_MOD, client_fd, &ev_mod);
-            }
-        }
-    }
+int Server::wait_timeout_ms() const {
+    uint64_t due = processor.next_timer_ns();
+    if (due == 0) return -1;
+    uint64_t now = monotonic_ns();
+    return due <= now ? 0 : static_cast<int>((due - now + 999999) / 1000000);
 }
 
 void Server::run() {
     epoll_event events[MAX_EVENTS];
     while (true) {
-        int nfds = epoll_wait(epoll_fd, events, MAX_EVENTS, -1);
+        // Connections in the ready queue have input waiting already.
+        int nfds = epoll_wait(epoll_fd, events, MAX_EVENTS, processor.has_ready() ? 0 : wait_timeout_ms());
         if (nfds < 0) {
+            if (errno == EINTR) continue;
             perror("epoll_wait");
             break;
         }
+        loop_started = monotonic_ns();
+        processor.expire_timers(loop_started, [this](Connection& conn) {
+            close_client(ConnectionTable<Client>::fd_of(conn.id));
+        });
 
         for (int i = 0; i < nfds; ++i) {
-            int fd = events[i].data.fd;
-            if (fd == server_fd) {
+            uint64_t id = events[i].data.u64;
+            if (id == LISTENER_ID) {
                 handle_new_connection();
+            } else if (id == COMPLETIONS_ID) {
+                handle_completions();
             } else {
-                handle_client_data(fd, events[i].events);
+                handle_client_data(id, events[i].events);
             }
         }
+        processor.run_ready([this](uint64_t id) -> Connection* { return clients.find(id); },
+                            [this](Connection& conn) { handle_client_data(conn.id, EPOLLIN); });
+        processor.finish_iteration(loop_started);
     }
 }
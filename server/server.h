@@ -1,39 +1,47 @@
 #pragma once
 
-#include <map>
-#include <string>
-#include <netinet/in.h>
+#include <cstdint>
 #include <sys/epoll.h>
-#include "ICalc.h"
-
-class Server {
+#include "Connection.h"
+#include "ConnectionTable.h"
+#include "IReactor.h"
+#include "RequestProcessor.h"
+#include "ServerOptions.h"
+
+// Edge-triggered epoll reactor.
+class Server : public IReactor {
 public:
-    explicit Server(int port);
-    ~Server();
+    explicit Server(const ServerOptions& options);
+    ~Server() override;
+
+    void run() override;
 
-    void run();
+    const ResultCache::Stats& cache_stats() const { return processor.cache_stats(); }
 
 private:
     int server_fd = -1;
     int epoll_fd = -1;
 
-    struct Client {
-        std::string in_buf;
-        std::string out_buf;
-        size_t out_sent = 0;
-        sockaddr_in addr{};
-        bool closing = false;
+    struct Client : Connection {
+        // Interest set currently registered with epoll (EPOLLIN/EPOLLOUT).
+        uint32_t events = EPOLLIN;
     };
-    std::map<int, Client> clients;
+    // Declared first so that it outlives the connections, which give
+    // their buffers back to its pool.
+    RequestProcessor processor;
+    ConnectionTable<Client> clients;
 
-    CalcImpl calc;
+    // Bytes one turn of a connection may read.
+    size_t read_budget;
 
-    int set_nonblocking(int fd);
+    // When the current batch of events came back from epoll_wait().
+    uint64_t loop_started = 0;
 
     void handle_new_connection();
-    void handle_client_data(int client_fd, uint32_t events);
-
-    std::string current_timestamp();
-    void log_message(const sockaddr_in& addr, const std::string& prefix, const std::string& message);
-    std::string format_double_2dp(double val);
+    void handle_client_data(uint64_t id, uint32_t events);
+    void handle_completions();
+    bool flush_output(int client_fd, Client& client);
+    void set_events(int client_fd, uint32_t events);
+    int wait_timeout_ms() const;
+    void close_client(int client_fd);
 };